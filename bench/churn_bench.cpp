@@ -0,0 +1,139 @@
+// window churn client: creates, maps, configures and destroys windows and
+// measures how long the window manager takes to place each new window.
+// Windows are created at 0, 0, which ywm moves on MapNotify; the first
+// ConfigureNotify with a different position marks the window as placed.
+// usage: churn_bench [windows] [in flight] [configures per window]
+// prints one JSON object
+#include <xcb/xcb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+static uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+struct Pending {
+	xcb_window_t win;
+	uint64_t created_ns; // when create + map were sent
+};
+
+static double pct(vector<uint64_t> &v, double frac) {
+	if(v.empty()) return 0;
+	return v[min(v.size() - 1, size_t(v.size() * frac))] / 1000.0;
+}
+
+int main(int argc, char **argv) {
+	int nwin = argc > 1? atoi(argv[1]): 2000;
+	int inflight = argc > 2? atoi(argv[2]): 32;
+	int nconf = argc > 3? atoi(argv[3]): 4;
+	const uint64_t timeout_ns = 2000000000; // give up on a window
+
+	xcb_connection_t *conn = xcb_connect(NULL, NULL);
+	if(xcb_connection_has_error(conn)) {
+		fprintf(stderr, "can't connect to X server\n");
+		return 1;
+	}
+	xcb_screen_t *screen = xcb_setup_roots_iterator(
+					xcb_get_setup(conn)).data;
+
+	vector<Pending> pending; // created, not placed yet
+	vector<uint64_t> lat; // create to placed, ns
+	int created = 0, unplaced = 0;
+	uint64_t start = now_ns();
+	while(created < nwin || !pending.empty()) {
+		while(created < nwin && int(pending.size()) < inflight) {
+			Pending p;
+			p.win = xcb_generate_id(conn);
+			uint32_t mask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
+			uint32_t values[2] = { screen->white_pixel,
+					XCB_EVENT_MASK_STRUCTURE_NOTIFY };
+			xcb_create_window(conn, XCB_COPY_FROM_PARENT, p.win,
+				screen->root, 0, 0, 200 + created % 300,
+				100 + created % 200, 0,
+				XCB_WINDOW_CLASS_INPUT_OUTPUT,
+				screen->root_visual, mask, values);
+			xcb_map_window(conn, p.win);
+			p.created_ns = now_ns();
+			pending.push_back(p);
+			created++;
+		}
+		xcb_flush(conn);
+
+		struct pollfd pfd = { xcb_get_file_descriptor(conn), POLLIN, 0 };
+		xcb_generic_event_t *ev = xcb_poll_for_event(conn);
+		if(!ev) {
+			poll(&pfd, 1, 100);
+			ev = xcb_poll_for_event(conn);
+		}
+		if(xcb_connection_has_error(conn)) {
+			fprintf(stderr, "X connection lost\n");
+			return 1;
+		}
+		uint64_t now = now_ns();
+		for(; ev; free(ev), ev = xcb_poll_for_event(conn)) {
+			if((ev->response_type & ~0x80) != XCB_CONFIGURE_NOTIFY) {
+				continue;
+			}
+			xcb_configure_notify_event_t *e =
+				(xcb_configure_notify_event_t *)ev;
+			if(e->x == 0 && e->y == 0) continue;
+			size_t i;
+			for(i = 0; i < pending.size() &&
+					pending[i].win != e->window; i++);
+			if(i == pending.size()) continue; // already placed
+			lat.push_back(now - pending[i].created_ns);
+			// the client moves and resizes it a few times, then
+			// the window goes away
+			for(int c = 0; c < nconf; c++) {
+				uint32_t v[4] = { uint32_t(e->x + c * 7),
+					uint32_t(e->y + c * 5),
+					uint32_t(e->width + c),
+					uint32_t(e->height + c) };
+				xcb_configure_window(conn, e->window,
+					XCB_CONFIG_WINDOW_X |
+					XCB_CONFIG_WINDOW_Y |
+					XCB_CONFIG_WINDOW_WIDTH |
+					XCB_CONFIG_WINDOW_HEIGHT, v);
+			}
+			xcb_destroy_window(conn, e->window);
+			pending.erase(pending.begin() + i);
+		}
+		// windows the window manager never placed
+		for(size_t i = 0; i < pending.size();) {
+			if(now - pending[i].created_ns < timeout_ns) {
+				i++;
+				continue;
+			}
+			xcb_destroy_window(conn, pending[i].win);
+			pending.erase(pending.begin() + i);
+			unplaced++;
+		}
+	}
+	double elapsed = (now_ns() - start) / 1e9;
+	xcb_disconnect(conn);
+
+	sort(lat.begin(), lat.end());
+	uint64_t sum = 0;
+	for(size_t i = 0; i < lat.size(); i++) sum += lat[i];
+	printf("{\"windows\": %d, \"in_flight\": %d, "
+		"\"configures_per_window\": %d, \"placed\": %d, "
+		"\"unplaced\": %d, \"elapsed_s\": %.3f, "
+		"\"windows_per_s\": %.1f, \"place_us\": {\"mean\": %.1f, "
+		"\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, "
+		"\"max\": %.1f}}\n",
+		nwin, inflight, nconf, int(lat.size()), unplaced, elapsed,
+		nwin / elapsed, lat.empty()? 0: sum / 1000.0 / lat.size(),
+		pct(lat, 0.5), pct(lat, 0.9), pct(lat, 0.99),
+		pct(lat, 1.0));
+	return 0;
+}
+
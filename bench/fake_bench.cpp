@@ -0,0 +1,141 @@
+// event handling without an X server: ywm runs against FakeX, the events of
+// a few typical workloads are fed through Wm::handle_batch and the time per
+// event and the requests it causes are printed as JSON lines.
+// usage: fake_bench [windows] [events per workload]
+#define YWM_NO_MAIN
+#include "../ywm.cpp"
+#include "../fakex.hpp"
+
+// feed evs in batches of at most batch events; whatever the fake server
+// queues in reply (ConfigureNotify) goes into the next batch. Adds up the
+// time and the number of events handled
+static void feed(Wm &wm, FakeX &fx, vector<xcb_generic_event_t *> &evs,
+				int batch, uint64_t &ns, uint64_t &nev) {
+	xcb_generic_event_t *b[256];
+	size_t i = 0;
+	uint64_t start = now_ns();
+	while(1) {
+		int n = 0;
+		xcb_generic_event_t *ev;
+		while(n < batch && (ev = fx.poll_for_event())) b[n++] = ev;
+		while(n < batch && i < evs.size()) b[n++] = evs[i++];
+		if(!n) break;
+		nev += n;
+		wm.handle_batch(b, n);
+	}
+	ns += now_ns() - start;
+	evs.clear();
+}
+
+static void report(const char *name, int batch, uint64_t ns, uint64_t nev,
+							uint64_t nreq) {
+	printf("{\"workload\": \"%s\", \"batch\": %d, \"events\": %lu, "
+		"\"ns_per_event\": %.1f, \"events_per_s\": %.0f, "
+		"\"requests_per_event\": %.2f}\n", name, batch,
+		(unsigned long)nev, double(ns) / nev, nev * 1e9 / ns,
+		double(nreq) / nev);
+}
+
+static void run(const char *name, Wm &wm, FakeX &fx,
+		vector<xcb_generic_event_t *> &evs, int batch) {
+	uint64_t req0 = fx.total_requests(), ns = 0, nev = 0;
+	feed(wm, fx, evs, batch, ns, nev);
+	report(name, batch, ns, nev, fx.total_requests() - req0);
+}
+
+int main(int argc, char **argv) {
+	int nwin = argc > 1? atoi(argv[1]): 1000;
+	int nev = argc > 2? atoi(argv[2]): 1000000;
+	setenv("YWM_BAR_FPS", "30", 0);
+	setenv("YWM_SNAP", "10", 0);
+	// nothing here waits for a timer: with a delay no focus would ever
+	// come due. At 0 the last window entered in a batch gets it
+	setenv("YWM_FOCUS_DELAY", "0", 0);
+	FakeX fx;
+	fx.keep_requests = false;
+	Wm wm;
+	wm.init_fake(&fx, &fx.screen);
+	vector<xcb_generic_event_t *> evs;
+	xcb_window_t first = 0x400000;
+
+	// windows come and go: create, map (placement), destroy. Built a few
+	// at a time, the fake server forgets a window as soon as the
+	// DestroyNotify is made
+	{
+		uint64_t req0 = fx.total_requests(), ns = 0, n = 0;
+		for(int i = 0; i < nev / 3; i++) {
+			xcb_window_t w = first + nwin + i;
+			evs.push_back(fx.client_create(w, 0, 0, 400 + i % 300,
+						300 + i % 200, "xterm"));
+			evs.push_back(fx.client_map(w));
+			if(i % 16 == 15) {
+				feed(wm, fx, evs, 1, ns, n);
+				for(int j = i - 15; j <= i; j++) {
+					evs.push_back(fx.client_destroy(
+							first + nwin + j));
+				}
+				feed(wm, fx, evs, 1, ns, n);
+			}
+		}
+		report("create_map_destroy", 1, ns, n,
+					fx.total_requests() - req0);
+	}
+
+	// a steady set of windows for the rest
+	for(int i = 0; i < nwin; i++) {
+		xcb_window_t w = first + i;
+		evs.push_back(fx.client_create(w, 0, 0, 400, 300, "xterm"));
+		evs.push_back(fx.client_map(w));
+	}
+	run("setup", wm, fx, evs, 64);
+
+	// pointer sweeping across windows: focus follows it, once per batch
+	for(int batch = 1; batch <= 64; batch *= 64) {
+		for(int i = 0; i < nev; i++) {
+			evs.push_back(fx.enter(first + i % nwin, i % 1920,
+								500));
+		}
+		run("focus", wm, fx, evs, batch);
+	}
+
+	// drag a window around, one motion event per batch and then the
+	// same with everything the server would have queued in between
+	for(int pass = 0; pass < 2; pass++) {
+		evs.push_back(fx.button(true, 8, first, 100, 100));
+		for(int i = 0; i < nev; i++) {
+			evs.push_back(fx.motion(100 + i % 500, 100 + i % 300));
+		}
+		evs.push_back(fx.button(false, 8, first, 100, 100));
+		run("move", wm, fx, evs, pass? 64: 1);
+	}
+	printf("{\"windows\": %u, \"focus\": %u, \"flushes\": %lu}\n",
+		fx.wins.size(), fx.focus, (unsigned long)fx.nflushes);
+
+	// master/stack tiling of 128 windows, one more window comes and goes:
+	// only the stack windows which move are reconfigured
+	{
+		setenv("YWM_TILE", "master", 1);
+		FakeX tfx;
+		tfx.keep_requests = false;
+		Wm twm;
+		twm.init_fake(&tfx, &tfx.screen);
+		for(int i = 0; i < 128; i++) {
+			xcb_window_t w = first + i;
+			evs.push_back(tfx.client_create(w, 0, 0, 400, 300,
+								"xterm"));
+			evs.push_back(tfx.client_map(w));
+		}
+		run("tile_setup", twm, tfx, evs, 64);
+		// each of these moves most of the stack column
+		for(int i = 0; i < nev / 100; i++) {
+			xcb_window_t w = first + 128 + i;
+			evs.push_back(tfx.client_create(w, 0, 0, 400, 300,
+								"xterm"));
+			evs.push_back(tfx.client_map(w));
+			evs.push_back(tfx.client_destroy(w));
+		}
+		run("tile_map_destroy", twm, tfx, evs, 1);
+	}
+	return 0;
+}
+
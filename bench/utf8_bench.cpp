@@ -0,0 +1,99 @@
+// UTF-8 to XChar2b: the byte-at-a-time conversion ywm used to have against
+// utf8.hpp, on a few kinds of window titles. Build with -mavx2 to get the
+// 32 byte path, the default x86-64 build uses SSE2.
+// usage: utf8_bench [rounds]
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "../utf8.hpp"
+
+static uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// the old conversion, unchanged
+static int old_utf8toXChar2b(xcb_char2b_t *output_r, int outsize, const char *input,
+								int inlen) {
+	int j, k;
+	for(j =0, k=0; j < inlen && k < outsize; j ++) {
+		unsigned char c = input[j];
+		if(c < 128) {
+			output_r[k].byte1 = 0;
+			output_r[k].byte2 = c;
+			k++;
+		} else if(c < 0xC0) {
+			/* we're inside a character we don't know  */
+			continue;
+		} else switch(c&0xF0) {
+		case 0xC0: case 0xD0: /* two bytes 5+6 = 11 bits */
+			if(inlen < j + 1) { return k; }
+			output_r[k].byte1 = (c&0x1C) >> 2;
+			j++;
+			output_r[k].byte2 = ((c&0x3) << 6) + (input[j]&0x3F);
+			k++;
+			break;
+		case 0xE0: /* three bytes 4+6+6 = 16 bits */
+			if(inlen < j + 2) { return k; }
+			j++;
+			output_r[k].byte1 = ((c&0xF) << 4) + ((input[j]&0x3C)
+									>> 2);
+			c = input[j];
+			j++;
+			output_r[k].byte2 = ((c&0x3) << 6) + (input[j]&0x3F);
+			k++;
+			break;
+		case 0xFF:
+			/* the character uses more than 16 bits */
+			continue;
+		}
+	}
+	return k;
+}
+
+typedef int (*convert_fn)(xcb_char2b_t *, int, const char *, int);
+
+static void run(const char *impl, const char *name, convert_fn f,
+					const char *s, int rounds) {
+	xcb_char2b_t out[254];
+	int len = strlen(s), n = 0;
+	uint64_t sum = 0;
+	uint64_t start = now_ns();
+	for(int r = 0; r < rounds; r++) {
+		n = f(out, 254, s, len);
+		sum += out[n / 2].byte2; // keep the compiler honest
+		asm volatile("" ::: "memory");
+	}
+	uint64_t ns = now_ns() - start;
+	printf("{\"impl\": \"%s\", \"input\": \"%s\", \"bytes\": %d, "
+		"\"chars\": %d, \"ns_per_call\": %.1f, \"bytes_per_ns\": %.2f, "
+		"\"checksum\": %lu}\n", impl, name, len, n,
+		double(ns) / rounds, double(len) * rounds / ns,
+		(unsigned long)sum);
+}
+
+int main(int argc, char **argv) {
+	int rounds = argc > 1? atoi(argv[1]): 2000000;
+	static const char *inputs[][2] = {
+		{ "ascii", "user@host: ~/src/ywm - vim ywm.cpp "
+			"[+] (1 of 3) -- INSERT --" },
+		{ "ascii_long", "Mozilla Firefox - Performance engineering "
+			"notes: batching requests, coalescing events and "
+			"avoiding round-trips in X11 window managers" },
+		{ "cyrillic", "Терминал - пользователь@хост: ~/документы" },
+		{ "mixed", "README.md — ywm — Visual Studio Code [Administrator]"
+			" (Ωmega, 日本語)" },
+		{ "emoji", "Chat 💬 with 🐧 friends 🎉🎉" },
+	};
+	for(size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+		run("old", inputs[i][0], old_utf8toXChar2b, inputs[i][1],
+									rounds);
+		run("utf8.hpp", inputs[i][0], utf8toXChar2b, inputs[i][1],
+									rounds);
+	}
+	return 0;
+}
@@ -0,0 +1,90 @@
+// window table churn: std::map (what ywm used to have) against Wtable
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <map>
+#include <vector>
+
+#include "../wtable.hpp"
+
+using namespace std;
+
+static uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// xorshift, so both tables see the same sequence of operations
+static uint32_t rnd_state = 2463534242u;
+static uint32_t rnd() {
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+// every round one window is destroyed, one is created and the others are
+// looked up the way ConfigureNotify/EnterNotify do. Window ids come from a
+// few clients, each handing out increasing ids like X does
+template<typename Table>
+static void churn(const char *name, Table &t, int nwin, int rounds,
+							int lookups) {
+	vector<xcb_window_t> alive;
+	uint32_t next[4] = { 0x0200000, 0x0400000, 0x1a00000, 0x3e00000 };
+	rnd_state = 2463534242u;
+	for(int i = 0; i < nwin; i++) {
+		xcb_window_t w = next[i & 3]++;
+		t.insert(w).x = i;
+		alive.push_back(w);
+	}
+	uint64_t sum = 0;
+	uint64_t start = now_ns();
+	for(int r = 0; r < rounds; r++) {
+		uint32_t k = rnd() % alive.size();
+		t.erase(alive[k]);
+		alive[k] = next[r & 3]++;
+		t.insert(alive[k]).x = r;
+		for(int j = 0; j < lookups; j++) {
+			Wdata *wd = t.find(alive[rnd() % alive.size()]);
+			if(wd) sum += wd->x;
+		}
+	}
+	uint64_t ns = now_ns() - start;
+	printf("{\"table\": \"%s\", \"windows\": %d, \"rounds\": %d, "
+		"\"lookups_per_round\": %d, \"ns_per_round\": %.1f, "
+		"\"live\": %u, \"checksum\": %lu}\n", name, nwin, rounds,
+		lookups, double(ns) / rounds, (unsigned)t.size(),
+		(unsigned long)sum);
+}
+
+// std::map with the interface of Wtable
+class Maptable {
+public:
+	map<int, Wdata> m;
+	Wdata *find(xcb_window_t w) {
+		map<int, Wdata>::iterator it = m.find(w);
+		return it == m.end()? NULL: &it->second;
+	}
+	Wdata &insert(xcb_window_t w) { return m[w]; }
+	bool erase(xcb_window_t w) { return m.erase(w); }
+	uint32_t size() const { return m.size(); }
+};
+
+int main(int argc, char **argv) {
+	int nwin = argc > 1? atoi(argv[1]): 16384;
+	int rounds = argc > 2? atoi(argv[2]): 1000000;
+	{
+		Maptable t;
+		churn("std::map", t, nwin, rounds, 4);
+	}
+	{
+		Wtable<Wdata> t;
+		churn("Wtable", t, nwin, rounds, 4);
+		printf("{\"table\": \"Wtable\", \"capacity\": %u, "
+			"\"tombstones\": %u, \"slot_bytes\": %u}\n",
+			t.capacity(), t.tombstones(), (unsigned)sizeof(Wdata));
+	}
+	return 0;
+}
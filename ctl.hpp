@@ -0,0 +1,163 @@
+#pragma once
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// local control socket: clients connect to a unix stream socket and send
+// commands, one per line or several on a line separated by ';'. Whatever
+// has arrived is handed over in one go, so a script that sends a few
+// dozen commands in one write gets them applied together with a single
+// flush to the X server. The socket is only accessible to the user.
+// Replies are written back with a short timeout, so a client that doesn't
+// read can't stall the window manager for long.
+class Ctl {
+public:
+	Ctl(): lfd(-1) {}
+	~Ctl() { close(); }
+
+	// listen on path, replacing a socket left behind by a crash. Fails
+	// with EEXIST if path is something else and EADDRINUSE if another
+	// instance is listening on it
+	bool open(const char *sockpath) {
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if(strlen(sockpath) >= sizeof(addr.sun_path)) return false;
+		strcpy(addr.sun_path, sockpath);
+		struct stat st;
+		if(!lstat(sockpath, &st)) {
+			if(!S_ISSOCK(st.st_mode)) {
+				errno = EEXIST;
+				return false;
+			}
+			if(live(addr)) {
+				errno = EADDRINUSE;
+				return false;
+			}
+			unlink(sockpath);
+		}
+		lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK |
+							SOCK_CLOEXEC, 0);
+		if(lfd < 0) return false;
+		mode_t old = umask(077);
+		int r = bind(lfd, (struct sockaddr *)&addr, sizeof(addr));
+		umask(old);
+		if(r < 0 || listen(lfd, 8) < 0) {
+			::close(lfd);
+			lfd = -1;
+			return false;
+		}
+		path = sockpath;
+		return true;
+	}
+
+	void close() {
+		std::map<int, std::string>::iterator it;
+		for(it = partial.begin(); it != partial.end(); it++) {
+			::close(it->first);
+		}
+		partial.clear();
+		if(lfd < 0) return;
+		::close(lfd);
+		unlink(path.c_str());
+		lfd = -1;
+	}
+
+	int fd() const { return lfd; } // the listening socket
+
+	// a client that connected, -1 if there is none
+	int accept() {
+		int c = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+		if(c < 0) return -1;
+		struct timeval tv = { 0, 100000 }; // for replies
+		setsockopt(c, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+		partial[c] = std::string();
+		return c;
+	}
+
+	bool is_client(int fd) const { return partial.count(fd) != 0; }
+
+	// reads what client fd has sent and appends the complete commands
+	// to cmds. Returns false if the client has gone away, what it sent
+	// last is in cmds anyway; drop() it after handling them. A line
+	// longer than MAX_LINE gets an error and the client is to be dropped
+	// with nothing carried out. At most MAX_READ bytes are taken at a
+	// time, the rest makes the fd readable again
+	bool read(int fd, std::vector<std::string> &cmds) {
+		std::string &in = partial[fd];
+		char buf[4096];
+		ssize_t n;
+		size_t got = 0;
+		bool open = true;
+		while(got < MAX_READ) {
+			n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+			if(n > 0) {
+				in.append(buf, n);
+				got += n;
+				size_t nl = in.find_last_of(";\n");
+				size_t tail = nl == std::string::npos?
+					in.size(): in.size() - nl - 1;
+				if(tail <= MAX_LINE) continue;
+				in.clear();
+				reply(fd, "err line too long\n");
+				return false;
+			}
+			if(!n || errno != EAGAIN) {
+				open = false;
+				in += '\n'; // an unfinished last line counts
+			}
+			break;
+		}
+		size_t start = 0, end;
+		while((end = in.find_first_of(";\n", start)) !=
+							std::string::npos) {
+			size_t a = in.find_first_not_of(" \t\r", start);
+			if(a < end) cmds.push_back(in.substr(a, end - a));
+			start = end + 1;
+		}
+		in.erase(0, start);
+		return open;
+	}
+
+	// false if the reply could not be written, then drop() the client
+	bool reply(int fd, const std::string &s) {
+		size_t done = 0;
+		while(done < s.size()) {
+			ssize_t n = send(fd, s.data() + done, s.size() - done,
+								MSG_NOSIGNAL);
+			if(n <= 0) return false;
+			done += n;
+		}
+		return true;
+	}
+
+	void drop(int fd) {
+		partial.erase(fd);
+		::close(fd);
+	}
+
+private:
+	static const size_t MAX_LINE = 4096;
+	static const size_t MAX_READ = 65536; // per read() call
+	int lfd; // listening socket, -1 = none
+	std::string path;
+	std::map<int, std::string> partial; // clients: unfinished line
+
+	// somebody accepts connections on addr
+	static bool live(const struct sockaddr_un &addr) {
+		int s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if(s < 0) return false;
+		bool r = connect(s, (const struct sockaddr *)&addr,
+							sizeof(addr)) == 0;
+		::close(s);
+		return r;
+	}
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <stdint.h>
+
+// pointer-driven window move/resize: remembers where the drag started and
+// turns every new pointer position into window geometry for
+// xcb_configure_window. Shared by ywm and the y_move/y_resize helpers.
+class Drag {
+public:
+	int16_t origpos[2]; // initial pointer position
+	int16_t origwpos[2]; // initial window position
+	int16_t origwsize[2]; // initial window size
+
+	// remember pointer position and window geometry at the start
+	void start(int16_t px, int16_t py, int16_t x, int16_t y,
+						uint16_t w, uint16_t h) {
+		origpos[0] = px;
+		origpos[1] = py;
+		origwpos[0] = x;
+		origwpos[1] = y;
+		origwsize[0] = w;
+		origwsize[1] = h;
+	}
+
+	// window position following the pointer: values[0..1] = x, y
+	void move(int16_t px, int16_t py, uint32_t *values) const {
+		values[0] = int16_t(origwpos[0] + (px - origpos[0]));
+		values[1] = int16_t(origwpos[1] + (py - origpos[1]));
+	}
+
+	// all sides move in opposite directions: moving the pointer right
+	// makes the window wider, moving it up makes the window taller.
+	// values[0..3] = x, y, width, height. Returns false if the window
+	// would become smaller than 1 pixel, values are then left untouched
+	bool resize(int16_t px, int16_t py, uint32_t *values) const {
+		int8_t top = 1, right = 1, bottom = -1, left = -1;
+		int16_t dx = px - origpos[0];
+		int16_t dy = py - origpos[1];
+		int16_t w = int16_t(origwsize[0] + dx * right + dx * -left);
+		int16_t h = int16_t(origwsize[1] + dy * -top + dy * bottom);
+		if(w < 1 || h < 1) {
+			return false;
+		}
+		values[0] = int16_t(origwpos[0] + dx * left);
+		values[1] = int16_t(origwpos[1] + dy * top);
+		values[2] = w;
+		values[3] = h;
+		return true;
+	}
+};
+
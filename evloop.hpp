@@ -0,0 +1,158 @@
+#pragma once
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// what the event loop sleeps on: one epoll set with the X connection, a
+// signalfd for the signals ywm handles and a timerfd for the next deferred
+// job (status bar redraw, focus change). Signals are blocked and read
+// like any other input, so there are no handlers running at random points
+// and no EINTR; the timer is only reprogrammed when the deadline changes.
+// When nothing is pending ywm sleeps in epoll_wait without a timeout.
+// Other fds (the control socket and its clients) can be added with watch().
+class Evloop {
+public:
+	static const int X_READY = 1; // the X connection is readable
+	static const int SIGNALED = 2; // see signals()
+	static const int TIMER = 4; // the deadline has passed
+	static const int OTHER = 8; // watched fds are readable, see ready
+
+	uint64_t nwakeups, ntimer, nsignals; // for the statistics
+	std::vector<int> ready; // watched fds readable after wait()
+
+	Evloop(): nwakeups(0), ntimer(0), nsignals(0), ep(-1), sfd(-1),
+			tfd(-1), xfd(-1), armed(0), pending(0) {
+		sigemptyset(&set);
+	}
+	~Evloop() { close(); }
+
+	// blocks the signals the signalfd will take. Must come before any
+	// thread is started (the log writer): threads inherit the mask, and
+	// one with the signals unblocked would get them instead, and die of
+	// SIGUSR1 or SIGTERM
+	bool block(const int *sigs, int nsigs) {
+		sigemptyset(&set);
+		for(int i = 0; i < nsigs; i++) sigaddset(&set, sigs[i]);
+		return sigprocmask(SIG_BLOCK, &set, NULL) == 0;
+	}
+
+	// sets up the fds, after block(); false with errno set if any of it
+	// fails
+	bool open(int x_fd) {
+		xfd = x_fd;
+		ep = epoll_create1(EPOLL_CLOEXEC);
+		sfd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+		tfd = timerfd_create(CLOCK_MONOTONIC,
+					TFD_NONBLOCK | TFD_CLOEXEC);
+		if(ep < 0 || sfd < 0 || tfd < 0) return false;
+		return add(xfd) && add(sfd) && add(tfd);
+	}
+
+	void close() {
+		if(ep >= 0) ::close(ep);
+		if(sfd >= 0) ::close(sfd);
+		if(tfd >= 0) ::close(tfd);
+		ep = sfd = tfd = -1;
+	}
+
+	bool watch(int fd) { return add(fd); }
+	void unwatch(int fd) { epoll_ctl(ep, EPOLL_CTL_DEL, fd, NULL); }
+
+	// sleeps until there is something to do; deadline is in
+	// CLOCK_MONOTONIC ns, 0 = none. Returns X_READY | SIGNALED | TIMER |
+	// OTHER
+	int wait(uint64_t deadline) {
+		arm(deadline);
+		int r = collect(-1);
+		if(r >= 0) nwakeups++;
+		return r < 0? 0: r;
+	}
+
+	// the same without sleeping, for when there is X input queued
+	// already: signals and clients are not kept waiting behind it
+	int poll() {
+		int r = collect(0);
+		return r < 0? 0: r;
+	}
+
+	// signals received since the last call, bit n = signal n
+	uint64_t signals() {
+		uint64_t s = pending;
+		pending = 0;
+		return s;
+	}
+
+private:
+	int ep, sfd, tfd, xfd;
+	uint64_t armed; // deadline the timer is set to, 0 = none
+	uint64_t pending; // signals not taken by signals() yet
+	sigset_t set; // blocked signals, read from sfd
+
+	// epoll_wait with timeout ms, -1 on EINTR from a signal ywm doesn't
+	// handle
+	int collect(int timeout) {
+		ready.clear();
+		struct epoll_event evs[16];
+		int n = epoll_wait(ep, evs, 16, timeout);
+		if(n < 0) return -1;
+		int r = 0;
+		for(int i = 0; i < n; i++) {
+			int fd = evs[i].data.fd;
+			if(fd == xfd) {
+				r |= X_READY;
+			} else if(fd == sfd) {
+				r |= read_signals();
+			} else if(fd == tfd) {
+				uint64_t expirations;
+				if(read(tfd, &expirations, 8) == 8) {
+					ntimer++;
+					armed = 0;
+					r |= TIMER;
+				}
+			} else {
+				ready.push_back(fd);
+				r |= OTHER;
+			}
+		}
+		return r;
+	}
+
+	bool add(int fd) {
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		return epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) == 0;
+	}
+
+	void arm(uint64_t deadline) {
+		if(deadline == armed) return;
+		struct itimerspec its;
+		memset(&its, 0, sizeof(its)); // all zero disarms
+		its.it_value.tv_sec = deadline / 1000000000;
+		its.it_value.tv_nsec = deadline % 1000000000;
+		timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
+		armed = deadline;
+	}
+
+	int read_signals() {
+		struct signalfd_siginfo si[8];
+		ssize_t n;
+		int r = 0;
+		while((n = read(sfd, si, sizeof(si))) > 0) {
+			for(size_t i = 0; i < n / sizeof(si[0]); i++) {
+				uint32_t sig = si[i].ssi_signo;
+				if(sig < 64) pending |= uint64_t(1) << sig;
+				nsignals++;
+				r = SIGNALED;
+			}
+		}
+		return r;
+	}
+};
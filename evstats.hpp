@@ -0,0 +1,99 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// event handling statistics: number of events and a latency histogram of
+// the handling time per X event type and operating mode
+class Evstats {
+public:
+	static const int NTYPES = 36; // core event types, 35 = GenericEvent
+	static const int OTHER = NTYPES; // extension events (RandR, XKB...)
+	static const int NMODES = 4; // normal, move, resize, aux
+	static const int NBUCKETS = 32; // bucket i counts [2^i, 2^(i+1)) ns
+
+	struct Cell {
+		uint64_t count; // events handled
+		uint64_t total_ns; // time spent handling them
+		uint64_t max_ns; // slowest one
+		uint32_t hist[NBUCKETS];
+	};
+	Cell cell[NMODES][NTYPES + 1];
+
+	Evstats() {
+		memset(cell, 0, sizeof(cell));
+	}
+
+	void record(int mode, uint8_t type, uint64_t ns) {
+		Cell &c = cell[mode][type < NTYPES? type: OTHER];
+		c.count++;
+		c.total_ns += ns;
+		if(ns > c.max_ns) c.max_ns = ns;
+		c.hist[bucket(ns)]++;
+	}
+
+	static int bucket(uint64_t ns) {
+		int b = 63 - __builtin_clzll(ns | 1);
+		return b < NBUCKETS? b: NBUCKETS - 1;
+	}
+
+	// upper bound of the bucket holding the given fraction of events
+	static uint64_t percentile(const Cell &c, double frac) {
+		uint64_t want = uint64_t(c.count * frac), seen = 0;
+		for(int b = 0; b < NBUCKETS; b++) {
+			seen += c.hist[b];
+			if(seen > want) return uint64_t(2) << b;
+		}
+		return c.max_ns;
+	}
+
+	// one line per mode and event type that has been seen:
+	// mode event count mean_ns p50_ns p99_ns max_ns, then the nonzero
+	// histogram buckets as <upper bound in ns>:<count>
+	void dump(FILE *f) const {
+		static const char *modes[NMODES] = {
+			"normal", "move", "resize", "aux"
+		};
+		fprintf(f, "# mode event count mean_ns p50_ns p99_ns max_ns "
+							"histogram\n");
+		for(int m = 0; m < NMODES; m++) {
+			for(int t = 0; t <= OTHER; t++) {
+				const Cell &c = cell[m][t];
+				if(!c.count) continue;
+				fprintf(f, "%s %s %lu %lu %lu %lu %lu", modes[m],
+					name(t), (unsigned long)c.count,
+					(unsigned long)(c.total_ns / c.count),
+					(unsigned long)percentile(c, 0.5),
+					(unsigned long)percentile(c, 0.99),
+					(unsigned long)c.max_ns);
+				for(int b = 0; b < NBUCKETS; b++) {
+					if(!c.hist[b]) continue;
+					fprintf(f, " %lu:%u",
+						(unsigned long)2 << b, c.hist[b]);
+				}
+				fprintf(f, "\n");
+			}
+		}
+	}
+
+	static const char *name(int type) {
+		static const char *names[NTYPES] = {
+			"Error", "Reply", "KeyPress", "KeyRelease",
+			"ButtonPress", "ButtonRelease", "MotionNotify",
+			"EnterNotify", "LeaveNotify", "FocusIn", "FocusOut",
+			"KeymapNotify", "Expose", "GraphicsExpose", "NoExpose",
+			"VisibilityNotify", "CreateNotify", "DestroyNotify",
+			"UnmapNotify", "MapNotify", "MapRequest",
+			"ReparentNotify", "ConfigureNotify",
+			"ConfigureRequest", "GravityNotify", "ResizeRequest",
+			"CirculateNotify", "CirculateRequest",
+			"PropertyNotify", "SelectionClear",
+			"SelectionRequest", "SelectionNotify",
+			"ColormapNotify", "ClientMessage", "MappingNotify",
+			"GenericEvent"
+		};
+		if(type == OTHER) return "Other";
+		return type >= 0 && type < NTYPES? names[type]: "Unknown";
+	}
+};
+
@@ -0,0 +1,374 @@
+#pragma once
+#include <xcb/xcb.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <vector>
+
+#include "xbackend.hpp"
+#include "wtable.hpp"
+#include "stack.hpp"
+
+// in-memory X server for benchmarks: requests are counted and kept in a
+// list, windows are a table of geometries and names, get_geometry and
+// get_property are answered from it at once. Configuring, mapping and
+// unmapping a known window queue the notify events a real server would
+// send; the event builders below make the events of client windows coming
+// and going.
+class FakeX: public Xbackend {
+public:
+	enum { REQ_CONFIGURE, REQ_ATTRIBUTES, REQ_MAP, REQ_UNMAP, REQ_FOCUS,
+		REQ_ACTIVE, REQ_GRAB, REQ_CHANGE_GRAB, REQ_UNGRAB, REQ_KILL,
+		REQ_SEND_EVENT, REQ_CURSOR, REQ_TEXT, REQ_FILL, REQ_CLIP,
+		REQ_COPY, REQ_GEOMETRY, REQ_PROPERTY, REQ_NOOP, NREQ };
+
+	struct Request {
+		uint8_t op; // REQ_*
+		xcb_window_t window; // window or drawable, if any
+		uint32_t mask;
+		uint32_t values[4];
+	};
+
+	struct Fwin {
+		xcb_window_t window; // key in the Wtable
+		int16_t x, y;
+		uint16_t w, h;
+		char name[64]; // answer to _NET_WM_NAME and WM_NAME
+	};
+
+	xcb_screen_t screen; // root window and size for Wm::init_fake
+	Wtable<Fwin> wins; // client windows
+	Stack stack; // their stacking order, for above_sibling
+	std::vector<Request> requests; // in order, clear() when it gets big
+	bool keep_requests; // false: only count them
+	uint64_t nreq[NREQ]; // requests by type
+	uint64_t nflushes;
+	bool notify; // queue notify events on configure/map/unmap
+	xcb_window_t focus; // last set_input_focus
+
+	FakeX(uint16_t width = 1920, uint16_t height = 1080):
+			keep_requests(true), nflushes(0), notify(true),
+			focus(XCB_NONE), evhead(0), seq(0), next_id(0x200000),
+			nwritten(0) {
+		memset(&screen, 0, sizeof(screen));
+		screen.root = 0x100;
+		screen.width_in_pixels = width;
+		screen.height_in_pixels = height;
+		screen.white_pixel = 0xffffff;
+		screen.root_depth = 24;
+		memset(nreq, 0, sizeof(nreq));
+	}
+
+	~FakeX() {
+		for(size_t i = evhead; i < events.size(); i++) free(events[i]);
+	}
+
+	static const char *name(int op) {
+		static const char *names[NREQ] = {
+			"ConfigureWindow", "ChangeWindowAttributes",
+			"MapWindow", "UnmapWindow", "SetInputFocus",
+			"_NET_ACTIVE_WINDOW", "GrabPointer",
+			"ChangeActivePointerGrab", "UngrabPointer",
+			"KillClient", "SendEvent", "CreateGlyphCursor",
+			"Text", "PolyFillRectangle", "SetClipRectangles",
+			"CopyArea",
+			"GetGeometry", "GetProperty", "NoOperation"
+		};
+		return op >= 0 && op < NREQ? names[op]: "Unknown";
+	}
+
+	uint64_t total_requests() const {
+		uint64_t n = 0;
+		for(int i = 0; i < NREQ; i++) n += nreq[i];
+		return n;
+	}
+
+	// events the fake server has queued for the window manager
+	xcb_generic_event_t *poll_for_event() {
+		if(evhead == events.size()) {
+			events.clear();
+			evhead = 0;
+			return NULL;
+		}
+		return events[evhead++];
+	}
+
+	// a client creates a window: the CreateNotify for the root
+	xcb_generic_event_t *client_create(xcb_window_t w, int16_t x,
+		int16_t y, uint16_t width, uint16_t height,
+		const char *title = "") {
+		Fwin &f = wins.insert(w);
+		f.x = x; f.y = y; f.w = width; f.h = height;
+		strncpy(f.name, title, sizeof(f.name) - 1);
+		stack.add(w, x, y, width, height);
+		xcb_create_notify_event_t *e = alloc<xcb_create_notify_event_t>(
+							XCB_CREATE_NOTIFY);
+		e->parent = screen.root;
+		e->window = w;
+		e->x = x; e->y = y; e->width = width; e->height = height;
+		return (xcb_generic_event_t *)e;
+	}
+
+	xcb_generic_event_t *client_map(xcb_window_t w) {
+		stack.mapped(w, true);
+		xcb_map_notify_event_t *e = alloc<xcb_map_notify_event_t>(
+							XCB_MAP_NOTIFY);
+		e->event = screen.root;
+		e->window = w;
+		return (xcb_generic_event_t *)e;
+	}
+
+	xcb_generic_event_t *client_destroy(xcb_window_t w) {
+		wins.erase(w);
+		stack.remove(w);
+		xcb_destroy_notify_event_t *e =
+			alloc<xcb_destroy_notify_event_t>(XCB_DESTROY_NOTIFY);
+		e->event = screen.root;
+		e->window = w;
+		return (xcb_generic_event_t *)e;
+	}
+
+	// the pointer enters window w
+	xcb_generic_event_t *enter(xcb_window_t w, int16_t x, int16_t y) {
+		xcb_enter_notify_event_t *e = alloc<xcb_enter_notify_event_t>(
+							XCB_ENTER_NOTIFY);
+		e->root = screen.root;
+		e->event = w;
+		e->root_x = e->event_x = x;
+		e->root_y = e->event_y = y;
+		return (xcb_generic_event_t *)e;
+	}
+
+	// button press or release on the root, over window child
+	xcb_generic_event_t *button(bool press, uint8_t detail,
+			xcb_window_t child, int16_t x, int16_t y) {
+		xcb_button_press_event_t *e = alloc<xcb_button_press_event_t>(
+			press? XCB_BUTTON_PRESS: XCB_BUTTON_RELEASE);
+		e->detail = detail;
+		e->root = e->event = screen.root;
+		e->child = child;
+		e->root_x = e->event_x = x;
+		e->root_y = e->event_y = y;
+		return (xcb_generic_event_t *)e;
+	}
+
+	xcb_generic_event_t *motion(int16_t x, int16_t y) {
+		xcb_motion_notify_event_t *e =
+			alloc<xcb_motion_notify_event_t>(XCB_MOTION_NOTIFY);
+		e->root = e->event = screen.root;
+		e->root_x = e->event_x = x;
+		e->root_y = e->event_y = y;
+		return (xcb_generic_event_t *)e;
+	}
+
+	uint32_t generate_id() {
+		return next_id++;
+	}
+
+	void configure_window(xcb_window_t w, uint16_t mask,
+						const uint32_t *values) {
+		record(REQ_CONFIGURE, w, mask, values,
+				__builtin_popcount(mask));
+		Fwin *f = wins.find(w);
+		if(!f) return;
+		int i = 0;
+		if(mask & XCB_CONFIG_WINDOW_X) f->x = values[i++];
+		if(mask & XCB_CONFIG_WINDOW_Y) f->y = values[i++];
+		if(mask & XCB_CONFIG_WINDOW_WIDTH) f->w = values[i++];
+		if(mask & XCB_CONFIG_WINDOW_HEIGHT) f->h = values[i++];
+		if(mask & XCB_CONFIG_WINDOW_BORDER_WIDTH) i++;
+		if(mask & XCB_CONFIG_WINDOW_SIBLING) i++; // not supported
+		if(mask & XCB_CONFIG_WINDOW_STACK_MODE) {
+			if(values[i] == XCB_STACK_MODE_ABOVE) stack.raise(w);
+			if(values[i] == XCB_STACK_MODE_BELOW) stack.lower(w);
+		}
+		if(!notify) return;
+		xcb_configure_notify_event_t *e =
+			alloc<xcb_configure_notify_event_t>(
+						XCB_CONFIGURE_NOTIFY);
+		e->event = screen.root;
+		e->window = w;
+		e->x = f->x; e->y = f->y;
+		e->width = f->w; e->height = f->h;
+		e->above_sibling = stack.below(w);
+		events.push_back((xcb_generic_event_t *)e);
+	}
+	void change_window_attributes(xcb_window_t w, uint32_t mask,
+						const uint32_t *values) {
+		record(REQ_ATTRIBUTES, w, mask, values,
+				__builtin_popcount(mask));
+	}
+	void map_window(xcb_window_t w) {
+		record(REQ_MAP, w);
+		if(!wins.find(w)) return;
+		stack.mapped(w, true);
+		if(notify) events.push_back(client_map(w));
+	}
+	void unmap_window(xcb_window_t w) {
+		record(REQ_UNMAP, w);
+		if(!wins.find(w)) return;
+		stack.mapped(w, false);
+		if(!notify) return;
+		xcb_unmap_notify_event_t *e = alloc<xcb_unmap_notify_event_t>(
+							XCB_UNMAP_NOTIFY);
+		e->event = screen.root;
+		e->window = w;
+		events.push_back((xcb_generic_event_t *)e);
+	}
+	void set_input_focus(xcb_window_t w) {
+		record(REQ_FOCUS, w);
+		focus = w;
+	}
+	void set_active_window(xcb_window_t w) {
+		record(REQ_ACTIVE, w);
+	}
+	void grab_pointer(xcb_window_t w, uint16_t mask, xcb_cursor_t cursor) {
+		uint32_t v = cursor;
+		record(REQ_GRAB, w, mask, &v, 1);
+	}
+	void change_active_pointer_grab(xcb_cursor_t cursor, uint16_t mask) {
+		uint32_t v = cursor;
+		record(REQ_CHANGE_GRAB, XCB_NONE, mask, &v, 1);
+	}
+	void ungrab_pointer() {
+		record(REQ_UNGRAB, XCB_NONE);
+	}
+	void kill_client(xcb_window_t w) {
+		record(REQ_KILL, w);
+	}
+	void send_event(xcb_window_t w, const char *) {
+		record(REQ_SEND_EVENT, w);
+	}
+	void create_glyph_cursor(xcb_cursor_t cursor, xcb_font_t,
+							uint16_t glyph) {
+		uint32_t v = glyph;
+		record(REQ_CURSOR, cursor, 0, &v, 1);
+	}
+	void image_text_8(xcb_drawable_t d, xcb_gcontext_t, int16_t,
+						int16_t, const char *s) {
+		record(REQ_TEXT, d);
+		nwritten += strlen(s);
+	}
+	void poly_text_16(xcb_drawable_t d, xcb_gcontext_t, int16_t,
+			int16_t, uint32_t len, const uint8_t *) {
+		record(REQ_TEXT, d);
+		nwritten += len;
+	}
+	void fill_rectangle(xcb_drawable_t d, xcb_gcontext_t,
+						const xcb_rectangle_t &) {
+		record(REQ_FILL, d);
+	}
+	void set_clip(xcb_gcontext_t gc, const xcb_rectangle_t *r) {
+		uint32_t v[4] = { 0, 0, 0, 0 };
+		if(r) {
+			v[0] = r->x; v[1] = r->y;
+			v[2] = r->width; v[3] = r->height;
+		}
+		record(REQ_CLIP, gc, 0, v, r? 4: 0);
+	}
+	void copy_area(xcb_drawable_t, xcb_drawable_t dst, xcb_gcontext_t,
+		int16_t, int16_t, int16_t, int16_t, uint16_t, uint16_t) {
+		record(REQ_COPY, dst);
+	}
+	bool get_geometry(xcb_window_t w, int16_t *geom) {
+		record(REQ_GEOMETRY, w);
+		Fwin *f = wins.find(w);
+		if(!f) return false;
+		geom[0] = f->x; geom[1] = f->y;
+		geom[2] = f->w; geom[3] = f->h;
+		return true;
+	}
+	unsigned int get_property(xcb_window_t w, xcb_atom_t atom,
+							uint32_t) {
+		uint32_t v = atom;
+		record(REQ_PROPERTY, w, 0, &v, 1);
+		Pending p = { w, atom };
+		pending[seq] = p;
+		return seq;
+	}
+	// the reply is there as soon as it is asked for: the window's name
+	// as a STRING, or an error if the window does not exist
+	int poll_for_reply(unsigned int s, void **reply,
+					xcb_generic_error_t **err) {
+		*reply = NULL;
+		std::map<unsigned int, Pending>::iterator it = pending.find(s);
+		if(it == pending.end()) return 1; // discarded
+		Fwin *f = wins.find(it->second.window);
+		pending.erase(it);
+		if(!f) {
+			if(err) {
+				*err = (xcb_generic_error_t *)
+					calloc(1, sizeof(xcb_generic_error_t));
+				(*err)->error_code = XCB_WINDOW;
+				(*err)->sequence = s;
+			}
+			return 1;
+		}
+		size_t len = strlen(f->name);
+		xcb_get_property_reply_t *r = (xcb_get_property_reply_t *)
+			calloc(1, sizeof(xcb_get_property_reply_t) + len);
+		r->response_type = 1; // reply
+		r->format = 8;
+		r->sequence = s;
+		r->length = (len + 3) / 4;
+		r->type = XCB_ATOM_STRING;
+		r->value_len = len;
+		memcpy(r + 1, f->name, len);
+		*reply = r;
+		return 1;
+	}
+	void discard_reply(unsigned int s) {
+		pending.erase(s);
+	}
+	unsigned int no_operation() {
+		record(REQ_NOOP, XCB_NONE);
+		return seq;
+	}
+	uint64_t total_written() {
+		return nwritten;
+	}
+	void flush() {
+		nflushes++;
+	}
+
+private:
+	struct Pending {
+		xcb_window_t window;
+		xcb_atom_t atom;
+	};
+	std::map<unsigned int, Pending> pending; // property replies by seq
+	std::vector<xcb_generic_event_t *> events; // queued for the wm
+	size_t evhead; // next one poll_for_event returns
+	unsigned int seq; // sequence number of the last request
+	uint32_t next_id; // resource ids handed out by generate_id
+	uint64_t nwritten; // request bytes, roughly
+
+	void record(uint8_t op, xcb_window_t w, uint32_t mask = 0,
+			const uint32_t *values = NULL, int nvalues = 0) {
+		seq++;
+		nreq[op]++;
+		nwritten += 12 + 4 * nvalues;
+		if(!keep_requests) return;
+		Request r;
+		r.op = op;
+		r.window = w;
+		r.mask = mask;
+		memset(r.values, 0, sizeof(r.values));
+		if(nvalues > 4) nvalues = 4;
+		for(int i = 0; i < nvalues; i++) r.values[i] = values[i];
+		requests.push_back(r);
+	}
+
+	// events are malloc'ed 32 byte blocks like the ones from libxcb
+	template<typename E>
+	static E *alloc(uint8_t type) {
+		E *e = (E *)calloc(1, sizeof(xcb_generic_event_t));
+		e->response_type = type;
+		return e;
+	}
+
+	FakeX(const FakeX &); // not copyable
+	FakeX &operator=(const FakeX &);
+};
+
@@ -0,0 +1,123 @@
+#pragma once
+#include <spawn.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// starts programs straight from an argv with posix_spawnp: no /bin/sh, no
+// copy of the window manager's memory, and nothing to wait for, so a
+// launch costs the event loop a few tens of microseconds. Exited children
+// are collected by reap() after SIGCHLD. The time from the launch to the
+// first window being mapped is kept per program name; the window is
+// matched to the oldest launch still waiting for one, which is right for
+// terminals and most programs started one at a time.
+class Launcher {
+public:
+	struct Prog {
+		char name[32]; // argv[0]
+		uint32_t launched, mapped; // launches, windows matched
+		uint64_t sum_ns, max_ns; // launch to map
+	};
+	std::vector<Prog> progs;
+
+	Launcher(): nrunning(0), nfailed(0) {}
+
+	// argv[0] is searched in PATH, the environment is passed on. With
+	// timed false the launch doesn't wait for a window (programs that
+	// are recognized otherwise, like pool terminals). Returns the pid,
+	// -1 if the program could not be started
+	pid_t spawn(const char *const *argv, char **envp, uint64_t now,
+							bool timed = true) {
+		posix_spawnattr_t attr;
+		posix_spawnattr_init(&attr);
+		// the child starts with no signals blocked
+		sigset_t none;
+		sigemptyset(&none);
+		posix_spawnattr_setsigmask(&attr, &none);
+		posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+		pid_t pid;
+		int err = posix_spawnp(&pid, argv[0], NULL, &attr,
+						(char *const *)argv, envp);
+		posix_spawnattr_destroy(&attr);
+		if(err) {
+			nfailed++;
+			return -1;
+		}
+		nrunning++;
+		Pending p = { pid, prog(argv[0]), now };
+		progs[p.prog].launched++;
+		if(timed) pending.push_back(p);
+		return pid;
+	}
+
+	// a new top-level window was mapped: if a launch is waiting for one,
+	// returns the latency and the program's name, otherwise 0
+	uint64_t mapped(uint64_t now, const char **name) {
+		// a program which never maps a window shouldn't take the
+		// next one that comes along
+		while(!pending.empty() && now - pending[0].t > EXPIRE_NS) {
+			pending.erase(pending.begin());
+		}
+		if(pending.empty()) return 0;
+		Pending p = pending[0];
+		pending.erase(pending.begin());
+		Prog &pr = progs[p.prog];
+		uint64_t dt = now - p.t;
+		pr.mapped++;
+		pr.sum_ns += dt;
+		if(dt > pr.max_ns) pr.max_ns = dt;
+		*name = pr.name;
+		return dt;
+	}
+
+	// collects every child which has exited, returns how many
+	int reap() {
+		int n = 0, status;
+		pid_t pid;
+		while((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+			n++;
+			if(nrunning) nrunning--;
+			for(size_t i = 0; i < pending.size(); i++) {
+				if(pending[i].pid == pid) {
+					pending.erase(pending.begin() + i);
+					break;
+				}
+			}
+		}
+		return n;
+	}
+
+	uint32_t running() const { return nrunning; }
+	uint32_t failed() const { return nfailed; }
+
+private:
+	static const uint64_t EXPIRE_NS = 30000000000ull; // 30 s
+	struct Pending {
+		pid_t pid;
+		uint32_t prog; // index in progs
+		uint64_t t; // when it was launched
+	};
+	std::vector<Pending> pending; // no window mapped yet, oldest first
+	uint32_t nrunning; // children not reaped yet
+	uint32_t nfailed; // posix_spawnp errors
+
+	// index of the entry for this program, added if there is none
+	uint32_t prog(const char *path) {
+		const char *name = strrchr(path, '/');
+		name = name? name + 1: path;
+		for(size_t i = 0; i < progs.size(); i++) {
+			if(!strncmp(progs[i].name, name,
+						sizeof(progs[i].name) - 1)) {
+				return i;
+			}
+		}
+		Prog p;
+		memset(&p, 0, sizeof(p));
+		strncpy(p.name, name, sizeof(p.name) - 1);
+		progs.push_back(p);
+		return progs.size() - 1;
+	}
+};
@@ -0,0 +1,133 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+// where to put a new window so it covers as little of the others as
+// possible. The screen is a grid of CELL x CELL pixel cells. add/remove
+// are O(1): they only mark the corners of the rectangle in a 2D difference
+// array, so windows moving around cost next to nothing. find() turns that
+// into the number of windows over each cell and a summed-area table of
+// those, which gives the overlap of any candidate position in O(1), and
+// tries every cell position: O(cells), independent of the number of
+// windows (1920x1080 is 120x68 cells).
+class Place {
+public:
+	static const int CELL = 16; // pixels per cell side
+
+	Place(): sw(0), sh(0), top(0), gw(0), gh(0), dirty(true) {}
+
+	// screen size; the top pixel rows (status bar) are never used
+	void init(uint16_t width, uint16_t height, uint16_t reserved_top) {
+		sw = width;
+		sh = height;
+		top = reserved_top;
+		gw = (sw + CELL - 1) / CELL;
+		gh = (sh + CELL - 1) / CELL;
+		diff.assign((gw + 1) * (gh + 1), 0);
+		sat.assign((gw + 1) * (gh + 1), 0);
+		dirty = true;
+	}
+
+	void add(int16_t x, int16_t y, uint16_t w, uint16_t h) {
+		update(x, y, w, h, 1);
+	}
+
+	// same rectangle as was added
+	void remove(int16_t x, int16_t y, uint16_t w, uint16_t h) {
+		update(x, y, w, h, -1);
+	}
+
+	// least overlapping position for a w x h window, the topmost and then
+	// rightmost of equally good ones. Returns the overlap in cells
+	uint32_t find(uint16_t w, uint16_t h, int16_t &x, int16_t &y) {
+		if(dirty) build();
+		int cw = (w + CELL - 1) / CELL, ch = (h + CELL - 1) / CELL;
+		int cy0 = top / CELL; // the row the bar ends in
+		int cy1 = gh - ch, cx1 = gw - cw; // last rows/columns that fit
+		if(cy1 < cy0) cy1 = cy0;
+		if(cx1 < 0) cx1 = 0;
+		uint32_t best = UINT32_MAX;
+		int bx = 0, by = top;
+		for(int cy = cy0; cy <= cy1 && best; cy++) {
+			int py = pos(cy, h, top, sh);
+			for(int cx = cx1; cx >= 0; cx--) {
+				int px = pos(cx, w, 0, sw);
+				uint32_t o = sum(px, py, w, h);
+				if(o < best) {
+					best = o;
+					bx = px;
+					by = py;
+					if(!best) break;
+				}
+			}
+		}
+		x = bx;
+		y = by;
+		return best;
+	}
+
+private:
+	uint16_t sw, sh, top; // screen size, reserved rows
+	int gw, gh; // grid size in cells
+	std::vector<int32_t> diff; // 2D differences, (gw + 1) * (gh + 1)
+	std::vector<uint32_t> sat; // summed-area table, (gw + 1) * (gh + 1)
+	bool dirty; // diff changed since sat was built
+	std::vector<int32_t> cover; // windows over each cell of a row
+
+	// every cell the rectangle touches, clipped to the screen
+	void update(int x, int y, int w, int h, int d) {
+		int cx0 = x < 0? 0: x / CELL, cy0 = y < 0? 0: y / CELL;
+		int cx1 = (x + w + CELL - 1) / CELL;
+		int cy1 = (y + h + CELL - 1) / CELL;
+		if(cx1 > gw) cx1 = gw;
+		if(cy1 > gh) cy1 = gh;
+		if(cx0 >= cx1 || cy0 >= cy1) return; // off the screen
+		diff[cy0 * (gw + 1) + cx0] += d;
+		diff[cy0 * (gw + 1) + cx1] -= d;
+		diff[cy1 * (gw + 1) + cx0] -= d;
+		diff[cy1 * (gw + 1) + cx1] += d;
+		dirty = true;
+	}
+
+	void build() {
+		cover.assign(gw + 1, 0);
+		for(int cy = 0; cy < gh; cy++) {
+			// the count of a cell is the sum of the differences above
+			// and left of it
+			int32_t run = 0;
+			uint32_t rowsum = 0;
+			for(int cx = 0; cx < gw; cx++) {
+				run += diff[cy * (gw + 1) + cx];
+				cover[cx] += run;
+				int32_t c = cover[cx];
+				rowsum += c > 0? c: 0;
+				sat[(cy + 1) * (gw + 1) + cx + 1] =
+					sat[cy * (gw + 1) + cx + 1] + rowsum;
+			}
+		}
+		dirty = false;
+	}
+
+	// where a window of size len goes for cell c: cell aligned, but
+	// kept within [lo, hi) when it fits there, so it may end up right
+	// below the bar or against the screen edge, off the cell grid
+	static int pos(int c, int len, int lo, int hi) {
+		int p = c * CELL;
+		if(p + len > hi) p = hi - len;
+		if(p < lo) p = lo;
+		return p;
+	}
+
+	// window cells over the cells a w x h rectangle at x, y touches, the
+	// partial ones included
+	uint32_t sum(int x, int y, int w, int h) const {
+		int cx = x / CELL, cy = y / CELL;
+		int x1 = (x + w + CELL - 1) / CELL;
+		int y1 = (y + h + CELL - 1) / CELL;
+		if(x1 > gw) x1 = gw;
+		if(y1 > gh) y1 = gh;
+		return sat[y1 * (gw + 1) + x1] - sat[cy * (gw + 1) + x1] -
+			sat[y1 * (gw + 1) + cx] + sat[cy * (gw + 1) + cx];
+	}
+};
+
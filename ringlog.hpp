@@ -0,0 +1,199 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <atomic>
+#include <thread>
+
+// asynchronous logger: the event thread formats a record into a slot of a
+// single-producer/single-consumer ring and returns, a background thread
+// writes the records to the file. When the ring is full records are
+// dropped and counted instead of blocking the caller.
+//
+// Text format, one line per record:
+//	<seconds since open> <E|W|I|D> <text>
+// Binary format (open(..., true)), after the 8 byte header "YWMLOG1\n":
+//	uint64_t ns, uint8_t level, uint8_t len, char text[len]
+// with ns = CLOCK_MONOTONIC nanoseconds, in host byte order.
+class Ringlog {
+public:
+	static const uint8_t ERR = 0, WARN = 1, INFO = 2, DEBUG = 3;
+	uint8_t level; // records above this level are not even formatted
+
+	Ringlog(): level(INFO), ring(NULL), fd(-1), wakefd(-1), head(0),
+			tail(0), ndropped(0), sleeping(false), stop(false) {}
+
+	~Ringlog() {
+		close();
+		delete[] ring;
+	}
+
+	// open (truncate) the log file and start the writer thread
+	bool open(const char *fname, bool binary = false) {
+		fd = ::open(fname, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+									0644);
+		if(fd < 0) return false;
+		wakefd = eventfd(0, EFD_CLOEXEC);
+		if(wakefd < 0) return false;
+		ring = new Record[NREC];
+		this->binary = binary;
+		if(binary) {
+			if(::write(fd, "YWMLOG1\n", 8) != 8) return false;
+		}
+		start_ns = now();
+		writer = std::thread(&Ringlog::run, this);
+		return true;
+	}
+
+	// write out everything that is queued and stop the writer thread
+	void close() {
+		if(!writer.joinable()) return;
+		stop.store(true);
+		wake();
+		writer.join();
+		::close(fd);
+		::close(wakefd);
+		fd = wakefd = -1;
+	}
+
+	__attribute__((format(printf, 2, 3)))
+	void err(const char *fmt, ...) {
+		va_list ap; va_start(ap, fmt); put(ERR, fmt, ap); va_end(ap);
+	}
+	__attribute__((format(printf, 2, 3)))
+	void warn(const char *fmt, ...) {
+		va_list ap; va_start(ap, fmt); put(WARN, fmt, ap); va_end(ap);
+	}
+	__attribute__((format(printf, 2, 3)))
+	void info(const char *fmt, ...) {
+		va_list ap; va_start(ap, fmt); put(INFO, fmt, ap); va_end(ap);
+	}
+	__attribute__((format(printf, 2, 3)))
+	void debug(const char *fmt, ...) {
+		va_list ap; va_start(ap, fmt); put(DEBUG, fmt, ap); va_end(ap);
+	}
+
+	uint64_t dropped() const { return ndropped.load(); }
+
+private:
+	static const uint32_t NREC = 4096; // ring size, power of 2
+	struct Record {
+		uint64_t ns; // CLOCK_MONOTONIC
+		uint8_t level;
+		uint8_t len; // bytes used in text
+		char text[118];
+	}; // 128 bytes, two cache lines
+	Record *ring; // NREC records
+	int fd; // log file
+	int wakefd; // eventfd to wake up the sleeping writer
+	bool binary; // binary record format
+	uint64_t start_ns; // when the log was opened
+	std::atomic<uint64_t> head; // next record to fill, producer only
+	std::atomic<uint64_t> tail; // next record to write, writer only
+	std::atomic<uint64_t> ndropped; // records lost because ring was full
+	std::atomic<bool> sleeping; // writer waits on wakefd
+	std::atomic<bool> stop;
+	std::thread writer;
+
+	static uint64_t now() {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+	}
+
+	void wake() {
+		uint64_t one = 1;
+		if(::write(wakefd, &one, 8) != 8) return; // writer is awake
+	}
+
+	void put(uint8_t lvl, const char *fmt, va_list ap) {
+		if(lvl > level || fd < 0) return;
+		uint64_t h = head.load(std::memory_order_relaxed);
+		if(h - tail.load(std::memory_order_acquire) >= NREC) {
+			ndropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		Record &r = ring[h & (NREC - 1)];
+		r.ns = now();
+		r.level = lvl;
+		int len = vsnprintf(r.text, sizeof(r.text), fmt, ap);
+		r.len = len < 0? 0: len < int(sizeof(r.text))? len:
+							sizeof(r.text) - 1;
+		head.store(h + 1);
+		// only costs a syscall when the writer has gone to sleep
+		if(sleeping.load() && sleeping.exchange(false)) wake();
+	}
+
+	// format one record into buf, returns number of bytes
+	size_t format(const Record &r, char *buf) {
+		if(binary) {
+			memcpy(buf, &r.ns, 8);
+			buf[8] = r.level;
+			buf[9] = r.len;
+			memcpy(buf + 10, r.text, r.len);
+			return 10 + r.len;
+		}
+		uint64_t ns = r.ns - start_ns;
+		int n = sprintf(buf, "%lu.%06lu %c ",
+				(unsigned long)(ns / 1000000000),
+				(unsigned long)(ns % 1000000000 / 1000),
+				"EWID"[r.level & 3]);
+		memcpy(buf + n, r.text, r.len);
+		buf[n + r.len] = '\n';
+		return n + r.len + 1;
+	}
+
+	void flush(char *buf, size_t &n) {
+		size_t done = 0;
+		while(done < n) {
+			ssize_t w = ::write(fd, buf + done, n - done);
+			if(w <= 0) break; // nothing sensible left to do
+			done += w;
+		}
+		n = 0;
+	}
+
+	// writer thread: drain the ring in big writes, sleep when it is empty
+	void run() {
+		static const size_t BUFSZ = 65536;
+		char *buf = new char[BUFSZ];
+		size_t n = 0;
+		uint64_t reported = 0; // dropped records already reported
+		while(1) {
+			uint64_t t = tail.load(std::memory_order_relaxed);
+			uint64_t h = head.load(std::memory_order_acquire);
+			for(; t != h; t++) {
+				if(n > BUFSZ - 256) flush(buf, n);
+				n += format(ring[t & (NREC - 1)], buf + n);
+				tail.store(t + 1, std::memory_order_release);
+			}
+			uint64_t d = ndropped.load();
+			if(d != reported) {
+				Record r;
+				r.ns = now();
+				r.level = WARN;
+				r.len = snprintf(r.text, sizeof(r.text),
+					"log full, %lu records dropped",
+					(unsigned long)(d - reported));
+				reported = d;
+				n += format(r, buf + n);
+			}
+			if(n) flush(buf, n);
+			if(stop.load() && tail.load() == head.load()) break;
+			sleeping.store(true);
+			if(head.load() != tail.load() || stop.load()) {
+				sleeping.store(false);
+				continue;
+			}
+			uint64_t v;
+			if(::read(wakefd, &v, 8) != 8) sleeping.store(false);
+		}
+		delete[] buf;
+	}
+};
+
@@ -0,0 +1,90 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+
+// edge snapping while moving or resizing a window: the vertical edges
+// (left and right sides) and the horizontal ones (tops and bottoms) of the
+// other windows and of the screen are kept in two sorted arrays, built once
+// when the drag starts. Every motion event then costs one binary search per
+// edge of the dragged window: O(log n), however many windows there are.
+class Snap {
+public:
+	Snap(): dist(0) {}
+
+	int16_t dist; // snap if an edge is this close, in pixels; 0 = off
+
+	// start over with the screen edges; the top rows (status bar) are
+	// left out, windows snap right below them
+	void clear(uint16_t sw, uint16_t sh, uint16_t reserved_top) {
+		xs.clear();
+		ys.clear();
+		xs.push_back(0);
+		xs.push_back(sw);
+		ys.push_back(reserved_top);
+		ys.push_back(sh);
+	}
+
+	void add(int16_t x, int16_t y, uint16_t w, uint16_t h) {
+		xs.push_back(x);
+		xs.push_back(x + w);
+		ys.push_back(y);
+		ys.push_back(y + h);
+	}
+
+	// after clear() and add()
+	void build() {
+		std::sort(xs.begin(), xs.end());
+		std::sort(ys.begin(), ys.end());
+	}
+
+	// moving: the window keeps its size, whichever of its two edges is
+	// closer to another edge decides
+	void move(int16_t &x, int16_t &y, uint16_t w, uint16_t h) const {
+		x += offset(xs, x, x + w);
+		y += offset(ys, y, y + h);
+	}
+
+	// resizing: both edges snap on their own
+	void resize(int16_t &x, int16_t &y, uint16_t &w, uint16_t &h) const {
+		side(xs, x, w);
+		side(ys, y, h);
+	}
+
+private:
+	std::vector<int32_t> xs, ys; // sorted edge positions
+
+	// distance from p to the nearest edge, dist + 1 if none is in reach
+	int32_t nearest(const std::vector<int32_t> &e, int32_t p) const {
+		std::vector<int32_t>::const_iterator it =
+			std::lower_bound(e.begin(), e.end(), p);
+		int32_t d = dist + 1;
+		if(it != e.end() && *it - p < abs(d)) d = *it - p;
+		if(it != e.begin() && p - it[-1] < abs(d)) d = it[-1] - p;
+		return d;
+	}
+
+	// how far to shift a window spanning a..b
+	int32_t offset(const std::vector<int32_t> &e, int32_t a,
+							int32_t b) const {
+		if(!dist) return 0;
+		int32_t da = nearest(e, a), db = nearest(e, b);
+		int32_t d = abs(da) <= abs(db)? da: db;
+		return abs(d) <= dist? d: 0;
+	}
+
+	// a and a + len snapped separately, keeping len >= 1
+	void side(const std::vector<int32_t> &e, int16_t &a,
+							uint16_t &len) const {
+		if(!dist) return;
+		int32_t lo = a, hi = a + len;
+		int32_t d = nearest(e, lo);
+		if(abs(d) <= dist) lo += d;
+		d = nearest(e, hi);
+		if(abs(d) <= dist) hi += d;
+		if(hi <= lo) return;
+		a = lo;
+		len = hi - lo;
+	}
+};
@@ -0,0 +1,128 @@
+#pragma once
+#include <xcb/xcb.h>
+#include <stdint.h>
+#include <vector>
+
+// stacking order of the top-level windows, bottom first, with their
+// geometry, as the server last reported it through CreateNotify,
+// ConfigureNotify (above_sibling), CirculateNotify, Map/UnmapNotify and
+// DestroyNotify. One flat array: a restack moves a few hundred bytes, and
+// the hit tests are a linear scan from the top over contiguous memory,
+// which beats chasing pointers at the window counts of a desktop.
+struct Srect {
+	xcb_window_t window;
+	int16_t x, y;
+	uint16_t w, h; // border not included
+	bool mapped;
+};
+
+class Stack {
+public:
+	uint32_t size() const { return v.size(); }
+	const Srect &operator[](uint32_t i) const { return v[i]; } // 0=bottom
+
+	// new windows go on top of their siblings
+	void add(xcb_window_t w, int16_t x, int16_t y, uint16_t width,
+							uint16_t height) {
+		int i = find(w);
+		if(i >= 0) v.erase(v.begin() + i);
+		Srect r = { w, x, y, width, height, false };
+		v.push_back(r);
+	}
+
+	void remove(xcb_window_t w) {
+		int i = find(w);
+		if(i >= 0) v.erase(v.begin() + i);
+	}
+
+	void mapped(xcb_window_t w, bool m) {
+		int i = find(w);
+		if(i >= 0) v[i].mapped = m;
+	}
+
+	// ConfigureNotify: new geometry, and w is right above sibling (at
+	// the bottom if sibling is XCB_NONE)
+	void configure(xcb_window_t w, xcb_window_t sibling, int16_t x,
+			int16_t y, uint16_t width, uint16_t height) {
+		int i = find(w);
+		if(i < 0) return;
+		v[i].x = x; v[i].y = y;
+		v[i].w = width; v[i].h = height;
+		move(i, sibling);
+	}
+
+	// put w right above sibling, at the bottom if sibling is XCB_NONE
+	void restack(xcb_window_t w, xcb_window_t sibling) {
+		int i = find(w);
+		if(i >= 0) move(i, sibling);
+	}
+
+	void raise(xcb_window_t w) {
+		if(!v.empty() && v.back().window != w) {
+			restack(w, v.back().window);
+		}
+	}
+
+	void lower(xcb_window_t w) {
+		restack(w, XCB_NONE);
+	}
+
+	// the window right below w, XCB_NONE if w is the bottom one
+	xcb_window_t below(xcb_window_t w) const {
+		int i = find(w);
+		return i > 0? v[i - 1].window: XCB_NONE;
+	}
+
+	// topmost mapped window containing the point, XCB_NONE if none
+	xcb_window_t at(int16_t x, int16_t y) const {
+		for(int i = int(v.size()) - 1; i >= 0; i--) {
+			const Srect &r = v[i];
+			if(r.mapped && x >= r.x && y >= r.y &&
+					x < r.x + r.w && y < r.y + r.h) {
+				return r.window;
+			}
+		}
+		return XCB_NONE;
+	}
+
+	// mapped windows intersecting the rectangle, topmost first, at most
+	// max of them into out; returns how many there are in total
+	int in_rect(int16_t x, int16_t y, uint16_t w, uint16_t h,
+				xcb_window_t *out, int max) const {
+		int n = 0;
+		for(int i = int(v.size()) - 1; i >= 0; i--) {
+			const Srect &r = v[i];
+			if(r.mapped && r.x < x + w && x < r.x + r.w &&
+					r.y < y + h && y < r.y + r.h) {
+				if(n < max) out[n] = r.window;
+				n++;
+			}
+		}
+		return n;
+	}
+
+private:
+	std::vector<Srect> v; // bottom first
+
+	void move(int i, xcb_window_t sibling) {
+		// most ConfigureNotify events don't change the order
+		if(i > 0? v[i - 1].window == sibling: sibling == XCB_NONE) {
+			return;
+		}
+		int j = sibling == XCB_NONE? -1: find(sibling);
+		if(sibling != XCB_NONE && j < 0) return; // unknown sibling
+		Srect r = v[i];
+		v.erase(v.begin() + i);
+		if(j > i) j--;
+		v.insert(v.begin() + j + 1, r);
+	}
+
+	// from the top: the windows being worked with are up there
+	int find(xcb_window_t w) const {
+		for(int i = int(v.size()) - 1; i >= 0; i--) {
+			if(v[i].window == w) return i;
+		}
+		return -1;
+	}
+};
+
@@ -0,0 +1,147 @@
+#pragma once
+#include <xcb/xcb.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// tiling layouts over the mapped windows: master/stack (the first window
+// on the left, the others in a column on the right) and grid. Each window
+// remembers the geometry it was last given, and layout() only returns
+// the windows whose geometry comes out different, so mapping or unmapping
+// one window reconfigures the ones that actually move and no others.
+// Computing the layout is a few integer operations per window; it is done
+// at most once per batch of events, when something has changed.
+class Tile {
+public:
+	enum { OFF, MASTER, GRID };
+
+	struct Geom {
+		xcb_window_t window;
+		int16_t x, y;
+		uint16_t w, h; // 0 = nothing given yet, or to be given again
+	};
+
+	Tile(): mode(OFF), master(55), ax(0), ay(0), aw(0), ah(0),
+							dirty(false) {}
+
+	int mode; // OFF, MASTER or GRID
+	int master; // percentage of the width for the master window
+
+	// "master", "grid" or anything else for OFF
+	static int parse(const char *s) {
+		if(!s) return OFF;
+		if(!strcmp(s, "master")) return MASTER;
+		if(!strcmp(s, "grid")) return GRID;
+		return OFF;
+	}
+
+	void set_mode(int m) {
+		mode = m;
+		dirty = true;
+	}
+
+	// the part of the screen windows are tiled in
+	void area(int16_t x, int16_t y, uint16_t w, uint16_t h) {
+		ax = x; ay = y; aw = w; ah = h;
+		dirty = true;
+	}
+
+	uint32_t size() const { return wins.size(); }
+	const Geom &operator[](uint32_t i) const { return wins[i]; }
+	bool has(xcb_window_t w) const { return find(w) >= 0; }
+
+	// new windows go last: at the bottom of the stack column
+	void add(xcb_window_t w) {
+		if(has(w)) return;
+		Geom g = { w, 0, 0, 0, 0 };
+		wins.push_back(g);
+		dirty = true;
+	}
+
+	void remove(xcb_window_t w) {
+		int i = find(w);
+		if(i < 0) return;
+		wins.erase(wins.begin() + i);
+		dirty = true;
+	}
+
+	// w is not where it was put (moved by hand, back from full screen):
+	// give it its place again on the next layout
+	void reset(xcb_window_t w) {
+		int i = find(w);
+		if(i < 0) return;
+		wins[i].w = wins[i].h = 0;
+		dirty = true;
+	}
+
+	// windows whose geometry has changed since the last call, with the
+	// new one; empty if nothing has changed or tiling is off
+	void layout(std::vector<Geom> &changed) {
+		changed.clear();
+		if(!dirty || mode == OFF || wins.empty()) {
+			dirty = false;
+			return;
+		}
+		dirty = false;
+		for(uint32_t i = 0; i < wins.size(); i++) {
+			Geom g = wins[i];
+			if(mode == MASTER) master_geom(i, g);
+			else grid_geom(i, g);
+			if(g.x != wins[i].x || g.y != wins[i].y ||
+					g.w != wins[i].w || g.h != wins[i].h) {
+				wins[i] = g;
+				changed.push_back(g);
+			}
+		}
+	}
+
+private:
+	int16_t ax, ay; // tiled area
+	uint16_t aw, ah;
+	bool dirty; // windows, area or mode changed since layout()
+	std::vector<Geom> wins; // in layout order, with the last geometry
+
+	int find(xcb_window_t w) const {
+		for(uint32_t i = 0; i < wins.size(); i++) {
+			if(wins[i].window == w) return i;
+		}
+		return -1;
+	}
+
+	// [a, a + len) split into n parts, the leftover pixels go to the
+	// first ones so the parts differ by one pixel at most
+	static void split(int a, int len, int n, int i, int16_t &pos,
+							uint16_t &size) {
+		int base = len / n, extra = len % n;
+		pos = a + i * base + (i < extra? i: extra);
+		size = base + (i < extra);
+	}
+
+	void master_geom(uint32_t i, Geom &g) const {
+		uint32_t n = wins.size();
+		if(n == 1) {
+			g.x = ax; g.y = ay; g.w = aw; g.h = ah;
+			return;
+		}
+		uint16_t mw = aw * master / 100;
+		if(!i) {
+			g.x = ax; g.y = ay; g.w = mw; g.h = ah;
+			return;
+		}
+		g.x = ax + mw;
+		g.w = aw - mw;
+		split(ay, ah, n - 1, i - 1, g.y, g.h);
+	}
+
+	// as many columns as rows or one more, the last row may be shorter
+	// and its windows wider
+	void grid_geom(uint32_t i, Geom &g) const {
+		uint32_t n = wins.size(), cols = 1;
+		while(cols * cols < n) cols++;
+		uint32_t rows = (n + cols - 1) / cols;
+		uint32_t row = i / cols, col = i % cols;
+		uint32_t inrow = row == rows - 1? n - row * cols: cols;
+		split(ax, aw, inrow, col, g.x, g.w);
+		split(ay, ah, rows, row, g.y, g.h);
+	}
+};
@@ -0,0 +1,88 @@
+#pragma once
+#include <xcb/xcb.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// event trace file: the raw events read from the X server, in the batches
+// they were handled in, so a replay coalesces and handles them the same way.
+// After the 8 byte header "YWMTRC1\n" every batch is
+//	uint64_t ns, uint32_t n, n * 32 bytes of events
+// with ns = CLOCK_MONOTONIC nanoseconds when the batch was read, in host
+// byte order. Only the 32 bytes of core events are kept, the full_sequence
+// of generic events is lost.
+class Trace {
+public:
+	static const int EVSIZE = 32; // bytes stored per event
+
+	Trace(): f(NULL) {}
+
+	~Trace() {
+		close();
+	}
+
+	bool open_write(const char *fname) {
+		f = fopen(fname, "we");
+		if(!f) return false;
+		setvbuf(f, NULL, _IOFBF, 1 << 16); // one write() per 2k events
+		return fwrite("YWMTRC1\n", 8, 1, f) == 1;
+	}
+
+	bool open_read(const char *fname) {
+		f = fopen(fname, "re");
+		if(!f) return false;
+		char hdr[8];
+		if(fread(hdr, 8, 1, f) != 1 || memcmp(hdr, "YWMTRC1\n", 8)) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close() {
+		if(f) fclose(f);
+		f = NULL;
+	}
+
+	bool is_open() const { return f != NULL; }
+
+	void flush() {
+		if(f) fflush(f);
+	}
+
+	void write(uint64_t ns, xcb_generic_event_t **evs, int n) {
+		uint32_t n32 = n;
+		fwrite(&ns, 8, 1, f);
+		fwrite(&n32, 4, 1, f);
+		for(int i = 0; i < n; i++) fwrite(evs[i], EVSIZE, 1, f);
+	}
+
+	// next batch into evs (at most max events, the rest of the batch is
+	// skipped), malloc'ed like the events from xcb. -1 at the end
+	int read(uint64_t &ns, xcb_generic_event_t **evs, int max) {
+		uint32_t n;
+		if(fread(&ns, 8, 1, f) != 1 || fread(&n, 4, 1, f) != 1) {
+			return -1;
+		}
+		int k = 0;
+		for(uint32_t i = 0; i < n; i++) {
+			xcb_generic_event_t *ev = (xcb_generic_event_t *)
+				calloc(1, sizeof(xcb_generic_event_t));
+			if(!ev || fread(ev, EVSIZE, 1, f) != 1) {
+				free(ev);
+				break; // truncated trace, keep what we have
+			}
+			if(k < max) evs[k++] = ev;
+			else free(ev);
+		}
+		return k;
+	}
+
+private:
+	FILE *f;
+
+	Trace(const Trace &); // not copyable
+	Trace &operator=(const Trace &);
+};
+
@@ -0,0 +1,128 @@
+#pragma once
+#include <xcb/xcb.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// UTF-8 to the 16 bit characters of xcb_poly_text_16 / xcb_image_text_16.
+// Runs of ASCII are widened 32 (AVX2) or 16 (SSE2) bytes at a time, the
+// rest is decoded one sequence at a time. Malformed sequences (stray or
+// missing continuation bytes, overlong forms, surrogates) and characters
+// outside the BMP, which XChar2b can't hold, become U+FFFD, one per
+// maximal invalid subpart like browsers do. Never reads past inlen.
+// Returns the number of characters written, at most outsize.
+
+static const uint16_t UTF8_REPLACEMENT = 0xFFFD;
+
+static inline void utf8_put(xcb_char2b_t *out, uint16_t c) {
+	out->byte1 = c >> 8;
+	out->byte2 = c & 0xFF;
+}
+
+// ASCII prefix of in widened into out, returns the number of bytes done
+static inline int utf8_ascii_run(xcb_char2b_t *out, int outsize,
+					const uint8_t *in, int inlen) {
+	int j = 0;
+#if defined(__AVX2__)
+	for(; j + 32 <= inlen && j + 32 <= outsize; j += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(in + j));
+		if(_mm256_movemask_epi8(v)) break; // a byte >= 0x80
+		// byte c becomes the little-endian word c << 8 = { 0, c }
+		__m256i lo = _mm256_slli_epi16(_mm256_cvtepu8_epi16(
+					_mm256_castsi256_si128(v)), 8);
+		__m256i hi = _mm256_slli_epi16(_mm256_cvtepu8_epi16(
+					_mm256_extracti128_si256(v, 1)), 8);
+		_mm256_storeu_si256((__m256i *)(out + j), lo);
+		_mm256_storeu_si256((__m256i *)(out + j + 16), hi);
+	}
+#endif
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	for(; j + 16 <= inlen && j + 16 <= outsize; j += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + j));
+		if(_mm_movemask_epi8(v)) break;
+		_mm_storeu_si128((__m128i *)(out + j),
+					_mm_unpacklo_epi8(zero, v));
+		_mm_storeu_si128((__m128i *)(out + j + 8),
+					_mm_unpackhi_epi8(zero, v));
+	}
+#endif
+	for(; j < inlen && j < outsize && in[j] < 0x80; j++) {
+		out[j].byte1 = 0;
+		out[j].byte2 = in[j];
+	}
+	return j;
+}
+
+static inline int utf8toXChar2b(xcb_char2b_t *out, int outsize,
+					const char *input, int inlen) {
+	const uint8_t *in = (const uint8_t *)input;
+	int j = 0, k = 0;
+	while(j < inlen && k < outsize) {
+		if(in[j] < 0x80) {
+			// single ASCII characters (spaces between words) are
+			// not worth setting up the vector loop for
+			if(j + 1 < inlen && in[j + 1] >= 0x80) {
+				out[k].byte1 = 0;
+				out[k++].byte2 = in[j++];
+				continue;
+			}
+			int n = utf8_ascii_run(out + k, outsize - k, in + j,
+								inlen - j);
+			j += n;
+			k += n;
+			continue;
+		}
+		uint8_t c = in[j];
+		// the common two byte case (Latin, Greek, Cyrillic...) first
+		if(uint8_t(c - 0xC2) <= 0xDF - 0xC2 && j + 1 < inlen &&
+					(in[j + 1] & 0xC0) == 0x80) {
+			do {
+				out[k].byte1 = (c >> 2) & 0x07;
+				out[k++].byte2 = (c << 6) | (in[j + 1] & 0x3F);
+				j += 2;
+				if(j + 1 >= inlen || k >= outsize) break;
+				c = in[j];
+			} while(uint8_t(c - 0xC2) <= 0xDF - 0xC2 &&
+					(in[j + 1] & 0xC0) == 0x80);
+			continue;
+		}
+		int need; // continuation bytes
+		uint8_t lo = 0x80, hi = 0xBF; // valid range of the first one
+		uint32_t cp;
+		if(c >= 0xC2 && c <= 0xDF) {
+			need = 1;
+			cp = c & 0x1F;
+		} else if(c >= 0xE0 && c <= 0xEF) {
+			need = 2;
+			cp = c & 0x0F;
+			if(c == 0xE0) lo = 0xA0; // overlong
+			if(c == 0xED) hi = 0x9F; // surrogates
+		} else if(c >= 0xF0 && c <= 0xF4) {
+			need = 3;
+			cp = c & 0x07;
+			if(c == 0xF0) lo = 0x90; // overlong
+			if(c == 0xF4) hi = 0x8F; // above U+10FFFF
+		} else { // continuation byte without a lead, C0, C1, F5..FF
+			utf8_put(out + k++, UTF8_REPLACEMENT);
+			j++;
+			continue;
+		}
+		int i;
+		for(i = 1; i <= need && j + i < inlen; i++) {
+			uint8_t b = in[j + i];
+			if(b < lo || b > hi) break;
+			cp = (cp << 6) | (b & 0x3F);
+			lo = 0x80; hi = 0xBF;
+		}
+		if(i <= need || cp > 0xFFFF) { // broken, or not in the BMP
+			cp = UTF8_REPLACEMENT;
+		}
+		utf8_put(out + k++, cp);
+		j += i;
+	}
+	return k;
+}
+
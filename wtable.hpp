@@ -0,0 +1,155 @@
+#pragma once
+#include <xcb/xcb.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// a small window's info structure that will be stored in a hashtable
+struct Wdata {
+	xcb_window_t window; // window, also the key in Wtable
+	xcb_window_t parent; // parent window
+	int16_t x, y; // coordinates
+	uint16_t w, h; // size
+	uint32_t flag; // 1=override redirect, 2=fullscreen, 4=mapped,
+			// 8=pool terminal
+};
+
+// flat open-addressing hashtable of window records with linear probing.
+// Slots are stored in one array, a window id of 0 marks an empty slot and
+// WT_TOMB a removed one. T must be trivially copyable and have a
+// 'xcb_window_t window' member, which is used as the key.
+template<typename T>
+class Wtable {
+public:
+	static const xcb_window_t WT_TOMB = 0xFFFFFFFF; // not a valid X id
+
+	Wtable(): slots(NULL), mask(0), bits(0), live(0), tombs(0) {
+		rehash(64);
+	}
+
+	~Wtable() {
+		free(slots);
+	}
+
+	// record of window w, or NULL if it is not in the table
+	T *find(xcb_window_t w) {
+		if(w == 0 || w == WT_TOMB) return NULL; // slot markers
+		for(uint32_t i = hash(w);; i = (i + 1) & mask) {
+			if(slots[i].window == w) return &slots[i];
+			if(slots[i].window == 0) return NULL;
+		}
+	}
+
+	// record of window w, a new zeroed one is added if it is not there.
+	// 0 and WT_TOMB can't be keys, they get a zeroed record which is not
+	// in the table
+	T &insert(xcb_window_t w) {
+		if(w == 0 || w == WT_TOMB) {
+			memset(&scratch, 0, sizeof(T));
+			return scratch;
+		}
+		if((live + tombs + 1) * 4 > (mask + 1) * 3) {
+			// grow if mostly live, otherwise just drop tombstones
+			rehash(live * 2 > mask + 1? (mask + 1) * 2: mask + 1);
+		}
+		T *tomb = NULL;
+		uint32_t i;
+		for(i = hash(w);; i = (i + 1) & mask) {
+			if(slots[i].window == w) return slots[i];
+			if(slots[i].window == 0) break;
+			if(slots[i].window == WT_TOMB && !tomb) {
+				tomb = &slots[i];
+			}
+		}
+		T *t = &slots[i];
+		if(tomb) {
+			t = tomb;
+			tombs--;
+		}
+		memset(t, 0, sizeof(T));
+		t->window = w;
+		live++;
+		return *t;
+	}
+
+	// remove window w, returns false if it was not in the table
+	bool erase(xcb_window_t w) {
+		T *t = find(w); // NULL for 0 and WT_TOMB
+		if(!t) return false;
+		live--;
+		uint32_t i = t - slots;
+		if(slots[(i + 1) & mask].window != 0) {
+			t->window = WT_TOMB; // keep probe chains intact
+			tombs++;
+			return true;
+		}
+		// end of a probe chain: this slot and the tombstones before it
+		// are not needed to reach anything anymore
+		t->window = 0;
+		for(i = (i - 1) & mask; slots[i].window == WT_TOMB;
+						i = (i - 1) & mask) {
+			slots[i].window = 0;
+			tombs--;
+		}
+		return true;
+	}
+
+	uint32_t size() const { return live; } // live records
+	uint32_t tombstones() const { return tombs; } // removed records
+	uint32_t capacity() const { return mask + 1; } // number of slots
+
+	// iterates over live records only: for(Wdata &wd: wdata) {...}
+	class iterator {
+	public:
+		iterator(T *p, T *end): p(p), end(end) { skip(); }
+		T &operator*() const { return *p; }
+		T *operator->() const { return p; }
+		iterator &operator++() { p++; skip(); return *this; }
+		bool operator!=(const iterator &o) const { return p != o.p; }
+	private:
+		T *p, *end;
+		void skip() {
+			while(p != end && (p->window == 0 ||
+						p->window == WT_TOMB)) p++;
+		}
+	};
+	iterator begin() { return iterator(slots, slots + mask + 1); }
+	iterator end() { return iterator(slots + mask + 1, slots + mask + 1); }
+
+private:
+	T *slots; // mask + 1 slots
+	uint32_t mask; // number of slots - 1, number of slots is 2^bits
+	uint8_t bits;
+	uint32_t live; // slots holding a record
+	uint32_t tombs; // slots holding WT_TOMB
+	T scratch; // what insert() returns for keys it can't hold
+
+	Wtable(const Wtable &); // not copyable
+	Wtable &operator=(const Wtable &);
+
+	// fibonacci hashing: ids differ mostly in the low bits
+	uint32_t hash(xcb_window_t w) const {
+		return (uint32_t(w) * 0x9E3779B1u) >> (32 - bits);
+	}
+
+	void rehash(uint32_t n) {
+		T *old = slots;
+		uint32_t oldn = old? mask + 1: 0;
+		slots = (T *)calloc(n, sizeof(T));
+		if(!slots) abort();
+		mask = n - 1;
+		for(bits = 0; (1u << bits) < n; bits++);
+		tombs = 0;
+		for(uint32_t j = 0; j < oldn; j++) {
+			if(old[j].window == 0 || old[j].window == WT_TOMB) {
+				continue;
+			}
+			uint32_t i;
+			for(i = hash(old[j].window); slots[i].window;
+						i = (i + 1) & mask);
+			slots[i] = old[j];
+		}
+		free(old);
+	}
+};
+
@@ -0,0 +1,175 @@
+#pragma once
+#include <xcb/xcb.h>
+#include <xcb/xcbext.h> // xcb_poll_for_reply
+#include <xcb/xcb_ewmh.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the X requests ywm makes while handling events. XcbX sends them to the
+// server, FakeX (fakex.hpp) keeps them in memory, so event handling can be
+// benchmarked and tried out without a display. Startup and shutdown
+// (init/release) talk to libxcb directly.
+class Xbackend {
+public:
+	virtual ~Xbackend() {}
+	virtual uint32_t generate_id() = 0;
+	virtual void configure_window(xcb_window_t w, uint16_t mask,
+					const uint32_t *values) = 0;
+	virtual void change_window_attributes(xcb_window_t w, uint32_t mask,
+					const uint32_t *values) = 0;
+	virtual void map_window(xcb_window_t w) = 0;
+	virtual void unmap_window(xcb_window_t w) = 0;
+	virtual void set_input_focus(xcb_window_t w) = 0; // pointer root
+	virtual void set_active_window(xcb_window_t w) = 0; // ewmh request
+	virtual void grab_pointer(xcb_window_t w, uint16_t mask,
+					xcb_cursor_t cursor) = 0;
+	virtual void change_active_pointer_grab(xcb_cursor_t cursor,
+					uint16_t mask) = 0;
+	virtual void ungrab_pointer() = 0;
+	virtual void kill_client(xcb_window_t w) = 0;
+	virtual void send_event(xcb_window_t w, const char *ev) = 0;
+	virtual void create_glyph_cursor(xcb_cursor_t cursor,
+					xcb_font_t font, uint16_t glyph) = 0;
+	virtual void image_text_8(xcb_drawable_t d, xcb_gcontext_t gc,
+				int16_t x, int16_t y, const char *s) = 0;
+	virtual void poly_text_16(xcb_drawable_t d, xcb_gcontext_t gc,
+		int16_t x, int16_t y, uint32_t len, const uint8_t *items) = 0;
+	virtual void fill_rectangle(xcb_drawable_t d, xcb_gcontext_t gc,
+					const xcb_rectangle_t &r) = 0;
+	// drawing with gc only touches r, NULL = no clipping
+	virtual void set_clip(xcb_gcontext_t gc,
+					const xcb_rectangle_t *r) = 0;
+	virtual void copy_area(xcb_drawable_t src, xcb_drawable_t dst,
+		xcb_gcontext_t gc, int16_t src_x, int16_t src_y,
+		int16_t dst_x, int16_t dst_y, uint16_t w, uint16_t h) = 0;
+	// waits for the reply, false if the window is gone
+	virtual bool get_geometry(xcb_window_t w, int16_t *geom) = 0;
+	// asynchronous property read, the sequence number is passed to
+	// poll_for_reply/discard_reply like with libxcb
+	virtual unsigned int get_property(xcb_window_t w, xcb_atom_t atom,
+					uint32_t long_length) = 0;
+	virtual int poll_for_reply(unsigned int seq, void **reply,
+					xcb_generic_error_t **err) = 0;
+	virtual void discard_reply(unsigned int seq) = 0;
+	virtual unsigned int no_operation() = 0; // returns the sequence
+	virtual uint64_t total_written() = 0; // bytes sent
+	virtual void flush() = 0;
+};
+
+// the real thing: every call is the libxcb request of the same name
+class XcbX: public Xbackend {
+public:
+	xcb_connection_t *conn;
+	xcb_ewmh_connection_t *ewconn;
+	int screen; // screen number, for ewmh requests
+
+	XcbX(): conn(NULL), ewconn(NULL), screen(0) {}
+
+	uint32_t generate_id() {
+		return xcb_generate_id(conn);
+	}
+	void configure_window(xcb_window_t w, uint16_t mask,
+						const uint32_t *values) {
+		xcb_configure_window(conn, w, mask, values);
+	}
+	void change_window_attributes(xcb_window_t w, uint32_t mask,
+						const uint32_t *values) {
+		xcb_change_window_attributes(conn, w, mask, values);
+	}
+	void map_window(xcb_window_t w) {
+		xcb_map_window(conn, w);
+	}
+	void unmap_window(xcb_window_t w) {
+		xcb_unmap_window(conn, w);
+	}
+	void set_input_focus(xcb_window_t w) {
+		xcb_set_input_focus(conn, XCB_INPUT_FOCUS_POINTER_ROOT, w,
+							XCB_CURRENT_TIME);
+	}
+	void set_active_window(xcb_window_t w) {
+		xcb_ewmh_request_change_active_window(ewconn, screen, w,
+			XCB_EWMH_CLIENT_SOURCE_TYPE_OTHER, XCB_CURRENT_TIME,
+			XCB_NONE);
+	}
+	void grab_pointer(xcb_window_t w, uint16_t mask, xcb_cursor_t cursor) {
+		xcb_grab_pointer(conn, 0, w, mask, XCB_GRAB_MODE_ASYNC,
+			XCB_GRAB_MODE_ASYNC, w, cursor, XCB_CURRENT_TIME);
+	}
+	void change_active_pointer_grab(xcb_cursor_t cursor, uint16_t mask) {
+		xcb_change_active_pointer_grab(conn, cursor, XCB_CURRENT_TIME,
+									mask);
+	}
+	void ungrab_pointer() {
+		xcb_ungrab_pointer(conn, XCB_CURRENT_TIME);
+	}
+	void kill_client(xcb_window_t w) {
+		xcb_kill_client(conn, w);
+	}
+	void send_event(xcb_window_t w, const char *ev) {
+		xcb_send_event(conn, false, w, XCB_EVENT_MASK_NO_EVENT, ev);
+	}
+	void create_glyph_cursor(xcb_cursor_t cursor, xcb_font_t font,
+							uint16_t glyph) {
+		xcb_create_glyph_cursor(conn, cursor, font, font, glyph,
+			glyph + 1, 0, 0, 0, 52428, 52428, 26214);
+	}
+	void image_text_8(xcb_drawable_t d, xcb_gcontext_t gc, int16_t x,
+						int16_t y, const char *s) {
+		xcb_image_text_8(conn, strlen(s), d, gc, x, y, s);
+	}
+	void poly_text_16(xcb_drawable_t d, xcb_gcontext_t gc, int16_t x,
+			int16_t y, uint32_t len, const uint8_t *items) {
+		xcb_poly_text_16(conn, d, gc, x, y, len, items);
+	}
+	void fill_rectangle(xcb_drawable_t d, xcb_gcontext_t gc,
+						const xcb_rectangle_t &r) {
+		xcb_poly_fill_rectangle(conn, d, gc, 1, &r);
+	}
+	void set_clip(xcb_gcontext_t gc, const xcb_rectangle_t *r) {
+		if(r) {
+			xcb_set_clip_rectangles(conn,
+				XCB_CLIP_ORDERING_UNSORTED, gc, 0, 0, 1, r);
+			return;
+		}
+		uint32_t none = XCB_NONE;
+		xcb_change_gc(conn, gc, XCB_GC_CLIP_MASK, &none);
+	}
+	void copy_area(xcb_drawable_t src, xcb_drawable_t dst,
+		xcb_gcontext_t gc, int16_t src_x, int16_t src_y,
+		int16_t dst_x, int16_t dst_y, uint16_t w, uint16_t h) {
+		xcb_copy_area(conn, src, dst, gc, src_x, src_y, dst_x, dst_y,
+									w, h);
+	}
+	bool get_geometry(xcb_window_t w, int16_t *geom) {
+		xcb_get_geometry_reply_t *g = xcb_get_geometry_reply(conn,
+					xcb_get_geometry(conn, w), NULL);
+		if(!g) return false;
+		geom[0] = g->x; geom[1] = g->y;
+		geom[2] = g->width; geom[3] = g->height;
+		free(g);
+		return true;
+	}
+	unsigned int get_property(xcb_window_t w, xcb_atom_t atom,
+							uint32_t long_length) {
+		return xcb_get_property(conn, 0, w, atom, XCB_ATOM_ANY, 0,
+						long_length).sequence;
+	}
+	int poll_for_reply(unsigned int seq, void **reply,
+					xcb_generic_error_t **err) {
+		return xcb_poll_for_reply(conn, seq, reply, err);
+	}
+	void discard_reply(unsigned int seq) {
+		xcb_discard_reply(conn, seq);
+	}
+	unsigned int no_operation() {
+		return xcb_no_operation(conn).sequence;
+	}
+	uint64_t total_written() {
+		return xcb_total_written(conn);
+	}
+	void flush() {
+		xcb_flush(conn);
+	}
+};
+
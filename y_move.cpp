@@ -3,14 +3,17 @@
 #include <unistd.h>
 #include <stdlib.h> // atoi
 
+#include "drag.hpp"
+
 int main(int argc, char **argv, char **envp) {
 	xcb_connection_t *conn; // xcb connection
 	xcb_screen_t *screen; // xcb screen
 	xcb_drawable_t rootwin, win; // window being operated upon
 	xcb_query_pointer_reply_t *pointer; // pointer position and stuff
 	xcb_get_geometry_reply_t *geom; // window's geometry request structure
-	int16_t offset[2]; // pointer's offset within window = const
-	int16_t oldpos[2]; // previous pointer position
+	xcb_grab_pointer_reply_t *grab; // result of the pointer grab
+	xcb_generic_event_t *ev; // event received from the server
+	Drag drag; // initial pointer position, window position and size
 	uint32_t values[2]; // used for calls to xcb_configure_window
 
 	// connect and get root window
@@ -22,37 +25,67 @@ int main(int argc, char **argv, char **envp) {
 	// get initial window and offset
 	pointer = xcb_query_pointer_reply(conn,
 				xcb_query_pointer(conn, rootwin), 0);
+	if(!pointer) return 1;
 	if(argc > 1) {
 		win = atoi(argv[1]);
 	} else {
 		win = pointer->child;
 	}
-	oldpos[0] = pointer->root_x;
-	oldpos[1] = pointer->root_y;
 
 	// we also need to calculate the offset from the window's position
 	geom = xcb_get_geometry_reply(conn,
 		xcb_get_geometry(conn, win), 0);
-	offset[0] = pointer->root_x - geom->x;
-	offset[1] = pointer->root_y - geom->y;
+	if(!geom) return 1;
+	drag.start(pointer->root_x, pointer->root_y, geom->x, geom->y,
+						geom->width, geom->height);
+	free(pointer);
+	free(geom);
 
-	while(1) {
-		usleep(50000); // sleep 50 milliseconds
-		pointer = xcb_query_pointer_reply(conn,
-			xcb_query_pointer(conn, rootwin), 0);
-		if(oldpos[0] == pointer->root_x &&
-					oldpos[1] == pointer->root_y) {
-			continue;
-		}
-		oldpos[0] = pointer->root_x;
-		oldpos[1] = pointer->root_y;
+	// motion is delivered to us until any button is released
+	grab = xcb_grab_pointer_reply(conn, xcb_grab_pointer(conn, 0, rootwin,
+		XCB_EVENT_MASK_BUTTON_RELEASE | XCB_EVENT_MASK_POINTER_MOTION,
+		XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC, XCB_NONE, XCB_NONE,
+		XCB_CURRENT_TIME), 0);
+	if(!grab || grab->status != XCB_GRAB_STATUS_SUCCESS) return 1;
+	free(grab);
 
-		values[0] = int16_t(pointer->root_x - offset[0]);
-		values[1] = int16_t(pointer->root_y - offset[1]);
-		xcb_configure_window(conn, win,
-				XCB_CONFIG_WINDOW_X |
-				XCB_CONFIG_WINDOW_Y, values);
-		xcb_flush(conn);
+	while((ev = xcb_wait_for_event(conn))) {
+		// only the latest of the queued motion events matters
+		xcb_generic_event_t *next;
+		while((ev->response_type & ~0x80) == XCB_MOTION_NOTIFY &&
+				(next = xcb_poll_for_event(conn))) {
+			free(ev);
+			ev = next;
+		}
+		switch(ev->response_type & ~0x80) {
+		case XCB_MOTION_NOTIFY: {
+			xcb_motion_notify_event_t *e =
+				(xcb_motion_notify_event_t *)ev;
+			drag.move(e->root_x, e->root_y, values);
+			xcb_configure_window(conn, win,
+					XCB_CONFIG_WINDOW_X |
+					XCB_CONFIG_WINDOW_Y, values);
+			xcb_flush(conn);
+			break;
+		}
+		case XCB_BUTTON_RELEASE: {
+			// the motion events right before it may have been
+			// skipped above: end where the button was released
+			xcb_button_release_event_t *e =
+				(xcb_button_release_event_t *)ev;
+			drag.move(e->root_x, e->root_y, values);
+			xcb_configure_window(conn, win,
+					XCB_CONFIG_WINDOW_X |
+					XCB_CONFIG_WINDOW_Y, values);
+			free(ev);
+			xcb_ungrab_pointer(conn, XCB_CURRENT_TIME);
+			xcb_flush(conn);
+			xcb_disconnect(conn);
+			return 0;
+		}
+		}
+		free(ev);
 	}
+	xcb_disconnect(conn);
 	return 0;
 }
@@ -1,4 +1,5 @@
 #include <xcb/xcb.h>
+#include <xcb/xcbext.h> // xcb_poll_for_reply
 #include <xcb/xcb_atom.h>
 #include <xcb/xcb_ewmh.h>
 #include <xcb/xcb_icccm.h>
@@ -10,58 +11,41 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 
 #include "vec.hpp"
+#include "drag.hpp"
+#include "wtable.hpp"
+#include "ringlog.hpp"
+#include "evstats.hpp"
+#include "trace.hpp"
+#include "xbackend.hpp"
+#include "utf8.hpp"
+#include "place.hpp"
+#include "stack.hpp"
+#include "snap.hpp"
+#include "launch.hpp"
+#include "evloop.hpp"
+#include "ctl.hpp"
+#include "tile.hpp"
 
-#include <iostream>
-#include <fstream>
+#include <string>
+#include <vector>
 #include <map>
 using namespace std;
 
-int utf8toXChar2b(xcb_char2b_t *output_r, int outsize, const char *input,
-								int inlen) {
-	int j, k;
-	for(j =0, k=0; j < inlen && k < outsize; j ++) {
-		unsigned char c = input[j];
-		if(c < 128) {
-			output_r[k].byte1 = 0;
-			output_r[k].byte2 = c;
-			k++;
-		} else if(c < 0xC0) {
-			/* we're inside a character we don't know  */
-			continue;
-		} else switch(c&0xF0) {
-		case 0xC0: case 0xD0: /* two bytes 5+6 = 11 bits */
-			if(inlen < j + 1) { return k; }
-			output_r[k].byte1 = (c&0x1C) >> 2;
-			j++;
-			output_r[k].byte2 = ((c&0x3) << 6) + (input[j]&0x3F);
-			k++;
-			break;
-		case 0xE0: /* three bytes 4+6+6 = 16 bits */
-			if(inlen < j + 2) { return k; }
-			j++;
-			output_r[k].byte1 = ((c&0xF) << 4) + ((input[j]&0x3C)
-									>> 2);
-			c = input[j];
-			j++;
-			output_r[k].byte2 = ((c&0x3) << 6) + (input[j]&0x3F);
-			k++;
-			break;
-		case 0xFF:
-			/* the character uses more than 16 bits */
-			continue;
-		}
-	}
-	return k;
+// monotonic clock in nanoseconds
+static uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
 }
 
-// a small window's info structure that will be stored in a hashtable
-struct Wdata {
-	uint64_t flag; // 1=override redirect, 2=fullscreen
-	xcb_window_t window; // window
-	xcb_window_t parent; // parent window
-	uint16_t x, y, w, h; // coordinates and size
+// window title, filled asynchronously from get_property replies
+struct Wtitle {
+	xcb_window_t window; // window, also the key in Wtable
+	unsigned int seq[2]; // pending _NET_WM_NAME, WM_NAME requests, 0=none
+	char name[256]; // _NET_WM_NAME if set, WM_NAME otherwise
 };
 
 class Wm {
@@ -70,56 +54,158 @@ public:
 	xcb_atom_t wm_protocols; // WM_PROTOCOLS atom
 	xcb_atom_t wm_delete_window; // WM_DELETE_WINDOW atom
 	void init(); // set up communication with the X server
-	void draw(); // handle refreshing of drawable areas
+	void draw(); // refresh the status bar if it changed and a frame is due
 	void event_loop(); // main event loop
-	xcb_atom_t getatom(char *atom_name);
+	void replay(const char *fname, bool fast); // handle a recorded trace
+	void init_fake(Xbackend *b, xcb_screen_t *s); // no server, fakex.hpp
+	bool handle_batch(xcb_generic_event_t **evs, int n); // false = quit
+	void release(); // free server resources and disconnect
+	bool handle_event(xcb_generic_event_t *ev); // false = quit
+	xcb_atom_t getatom(xcb_intern_atom_cookie_t cookie); // wait for reply
 private:
 	xcb_atom_t _NET_WM_NAME;
 	static const uint8_t OP_NORMAL = 0;
 	static const uint8_t OP_MOVE = 1;
 	static const uint8_t OP_RESIZE = 2;
 	static const uint8_t OP_AUX = 4;
-	map<int, Wdata>wdata; // a map of all windows referenced by id
+	Wtable<Wdata> wdata; // all windows referenced by id
 	uint8_t opmode; // 0=normal, 1=moving, 2=resizing
 	int32_t mainscreen; // used during connection
 	char *dispname; // name of display taken from env DISPLAY variable
-	ofstream log; // log file
+	Ringlog log; // log file, written by a background thread
 	xcb_connection_t *conn; // xcb connection
+	XcbX xcbx; // sends the requests of xsrv over conn
+	Xbackend *xsrv; // requests made while running go through this
 	xcb_ewmh_connection_t ewconn;
 	xcb_screen_t *screen; // xcb screen
 	xcb_drawable_t rootwin; // root window
 	xcb_drawable_t focuswin; // track input focus
+	// focus follows the pointer once it has rested on a window for
+	// YWM_FOCUS_DELAY ms, a sweep across windows focuses only the last
+	xcb_window_t focus_pending; // window to focus, XCB_NONE = nothing
+	uint64_t focus_due_ns; // when to focus it
+	uint64_t focus_delay_ns;
+	uint64_t nfocus, nfocus_skipped; // focus requests sent / saved
+	void focus_later(xcb_window_t w); // pointer entered w
+	void apply_focus(); // send the pending focus request if it is due
+	int focus_timeout(); // ms until the pending focus is due, -1 = none
 	xcb_drawable_t win; // a child window being acted upon
 	char winstr[20]; // the child iwndow's id converted to string
-	xcb_get_geometry_reply_t *geom; // geometry of a window
+	Drag drag; // pointer and window geometry at start of move/resize
+	int16_t wgeom[4]; // current x, y, w, h of the window being dragged
+	bool dragging; // false when motion should no longer move the window
 	xcb_gcontext_t fg, bg; // basic colors
 	xcb_gcontext_t mono1; // fixed-width font
 	xcb_gcontext_t sans1; // sans-serif font
 	xcb_gcontext_t serif1; // serif font
 	xcb_generic_error_t *error = NULL; // error from xcb if any
-	pid_t child_pid; // used when starting a subprocess
 
-	void check_cookie(xcb_void_cookie_t cookie, const char *err_msg);
+	struct Check { xcb_void_cookie_t cookie; const char *err_msg; };
+	vector<Check> checks; // checked requests not looked at yet
+	void check_later(xcb_void_cookie_t cookie, const char *err_msg);
+	void check_cookies(); // wait for the server once, exit on error
+	uint64_t start_ns; // when init() started, for time to first event
+	void init_state(); // the part of init() which needs no server
+	Wdata &track_window(xcb_window_t w, xcb_window_t parent,
+		uint8_t override_redirect, int16_t x, int16_t y,
+		uint16_t width, uint16_t height); // add to wdata
+	void adopt_windows(xcb_query_tree_cookie_t tree); // already there
 	struct TextItem; // used only inside draw_text function
+	struct TextCache;
+	static const int TEXT_CACHE = 16; // slots in text_cache
+	TextCache *text_cache; // draw_text results, TEXT_CACHE slots
+	uint64_t text_hits, text_misses;
 	void draw_text(xcb_gcontext_t fontgc, int16_t x, int16_t y,
 							const char *label);
 	char status[1024]; // debug status displayed in top left corner
 	char lastev[1024]; // last event received
+	static const int BATCH_MAX = 256; // max events handled per flush
+	uint64_t nevents; // events received
+	uint64_t ncoalesced; // events dropped in favour of a newer one
+	char evcount[64]; // batch size and coalesced counter for the bar
+	static const uint16_t BAR_H = 20; // height of the status bar
+	uint16_t bar_w; // width of the status bar = width of the screen
+	char drawn_status[1024]; // bar contents as last sent to the server
+	char drawn_lastev[1024];
+	char drawn_evcount[64];
+	xcb_pixmap_t bar_pix; // off-screen copy of the bar, blitted to root
+	void draw_field(xcb_gcontext_t fontgc, int16_t x, int16_t x1,
+					const char *text, char *drawn);
+	void expose_bar(int16_t x, int16_t y, uint16_t w, uint16_t h);
+	uint64_t bar_frame_ns; // min time between redraws, 0 = no limit
+	uint64_t bar_drawn_ns; // when the bar was last drawn
+	bool bar_dirty(); // bar contents differ from what is in bar_pix
+	int bar_timeout(); // ms until a pending redraw is due, -1 = none
+	Evloop loop; // epoll on the connection, signals and a timer
+	bool dump_requested; // SIGUSR1: write out the statistics
+	bool child_exited; // SIGCHLD: reap the children
+	int coalesce(xcb_generic_event_t **evs, int n);
+	Trace trace; // YWM_TRACE: every batch of events is recorded here
+	Evstats evstats; // handling time per event type and opmode
+	uint64_t nbatches; // batches handled
+	uint64_t nflushes; // xcb_flush calls
+	uint32_t ndumps; // statistics dumps so far
+	void flush(); // xcb_flush and count it
+	void dump_stats(); // write statistics to /tmp/wm$DISPLAY.stats
+	// cursor glyphs from the X cursor font
+	static const uint16_t CUR_NORMAL = 68; // left_ptr
+	static const uint16_t CUR_MOVE = 52; // fleur
+	static const uint16_t CUR_RESIZE = 120; // sizing
+	static const uint16_t CUR_AUX = 92; // question_arrow
+	static const uint16_t DRAG_EVENTS = XCB_EVENT_MASK_BUTTON_PRESS |
+		XCB_EVENT_MASK_BUTTON_RELEASE |
+		XCB_EVENT_MASK_POINTER_MOTION; // grab during move/resize
+	// server resources are created once on first use and reused
+	map<string, xcb_gcontext_t> font_gcs; // by font name
+	map<uint16_t, xcb_cursor_t> cursors; // by glyph
+	xcb_font_t cursor_font; // "cursor" font, opened in init()
 	xcb_gcontext_t get_font_gc(const char *font_name);
-	void set_cursor(xcb_screen_t *screen, xcb_window_t window, int cur_id);
-	void enter_move(); // enter move mode (opmode = 1)
-	void enter_resize(); // enter resize mode (opmode = 2)
+	xcb_cursor_t get_cursor(uint16_t cur_id);
+	void set_cursor(xcb_window_t window, uint16_t cur_id);
+	void get_wgeom(); // fill wgeom with the geometry of win
+	void enter_move(int16_t px, int16_t py); // move mode (opmode = 1)
+	void enter_resize(int16_t px, int16_t py); // resize mode (opmode = 2)
+	void drag_motion(int16_t px, int16_t py); // pointer moved during drag
+	Snap snap; // YWM_SNAP: edges the dragged window snaps to
+	void snap_start(); // index the edges of all windows but win
 	void print_status(const char *); // debug status message
-	size_t get_window_name(xcb_window_t win, char *buf, size_t len);
-	uint16_t offset_x, offset_y; // used when stacking windows
+	Wtable<Wtitle> titles; // title cache, refreshed on PropertyNotify
+	vector<xcb_window_t> title_pending; // in order of the requests
+	void request_title(xcb_window_t w); // (re)read title, don't wait
+	void collect_titles(); // take the title replies which have arrived
+	void forget_title(xcb_window_t w); // window destroyed
+	const char *get_title(xcb_window_t w); // cached title, "" if none
+	Place place; // free space index over the mapped windows
+	Stack stack; // stacking order and geometry, for hit tests
+	Launcher launcher; // programs started by ywm
+	void launch(const char *const *argv); // start a program, don't wait
+	// YWM_TERM_POOL terminals are started ahead of time off the screen
+	// and unmapped as soon as they appear; Mod4+Enter maps one of them
+	uint32_t pool_size;
+	vector<xcb_window_t> term_pool; // ready and unmapped
+	vector<uint64_t> pool_starting; // launch times, no window yet
+	uint64_t pool_taken_ns; // when the last one was taken out
+	void fill_pool(); // start terminals until there are pool_size
+	void new_terminal(); // Mod4+Enter
+	void raise_window(xcb_window_t w); // on top of the others
+	void focus_window(xcb_window_t w); // input focus, _NET_ACTIVE_WINDOW
+	void toggle_fullscreen(xcb_window_t w);
+	void close_window(xcb_window_t w); // WM_DELETE_WINDOW message
+	Ctl ctl; // YWM_CTL control socket
+	Tile tile; // YWM_TILE: tiling layout of the mapped windows
+	vector<Tile::Geom> tile_changed; // from the last layout
+	void set_tiling(int mode); // Tile::OFF, MASTER or GRID
+	void apply_layout(); // configure the windows the layout has moved
+	void tile_dropped(); // a move/resize of win has ended
+	void control(int fd); // the socket or one of its clients is readable
+	bool serve(); // control clients and signals, false = quit
+	void command(const char *cmd, string &reply); // one control command
 };
 
-xcb_atom_t Wm::getatom(char *atom_name) {
-	xcb_intern_atom_cookie_t atom_cookie;
+xcb_atom_t Wm::getatom(xcb_intern_atom_cookie_t atom_cookie) {
 	xcb_atom_t atom;
 	xcb_intern_atom_reply_t *rep;
 
-	atom_cookie = xcb_intern_atom(conn, 0, strlen(atom_name), atom_name);
 	rep = xcb_intern_atom_reply(conn, atom_cookie, NULL);
 	if(rep != NULL) {
 		atom = rep->atom;
@@ -129,36 +215,75 @@ xcb_atom_t Wm::getatom(char *atom_name) {
 	return 0;
 }
 
-void Wm::check_cookie(xcb_void_cookie_t cookie, const char *err_msg) {
-	error = xcb_request_check(conn, cookie);
-	if(error) {
-		xcb_disconnect(conn);
-		exit(-1);
+// errors of checked requests are collected in one go by check_cookies(),
+// so a series of requests costs one round-trip instead of one each
+void Wm::check_later(xcb_void_cookie_t cookie, const char *err_msg) {
+	Check c = { cookie, err_msg };
+	checks.push_back(c);
+}
+
+void Wm::check_cookies() {
+	for(size_t i = 0; i < checks.size(); i++) {
+		error = xcb_request_check(conn, checks[i].cookie);
+		if(error) {
+			log.err("%s: error %d", checks[i].err_msg,
+						int(error->error_code));
+			log.close(); // write it out before exiting
+			xcb_disconnect(conn);
+			exit(-1);
+		}
 	}
+	checks.clear();
 }
 
 struct Wm::TextItem {
-	uint8_t nchars;
+	uint8_t nchars; // 255 would mean a font change, so at most 254
 	int8_t	delta;
-	xcb_char2b_t text[257]; // 256 2byte characters
+	xcb_char2b_t text[254];
 };
 
+// converted labels, direct-mapped by hash: the bar keeps switching between
+// the same few window titles
+struct Wm::TextCache {
+	uint32_t hash; // of label, 0 = empty slot
+	char label[256];
+	TextItem ti;
+};
+
+static uint32_t label_hash(const char *s, size_t len) {
+	uint32_t h = 2166136261u; // FNV-1a
+	for(size_t i = 0; i < len; i++) h = (h ^ uint8_t(s[i])) * 16777619u;
+	return h | 1;
+}
+
 void Wm::draw_text(xcb_gcontext_t fontgc, int16_t x, int16_t y,
 							const char *label) {
-	TextItem ti;
-	ti.nchars = utf8toXChar2b(ti.text, 256, label, strlen(label));
-	ti.delta = 0;
-	xcb_void_cookie_t text_cookie = xcb_poly_text_16_checked(conn,
-		rootwin, fontgc, x, y, ti.nchars * 2 + 2, (const uint8_t*)&ti);
-	check_cookie(text_cookie, "can't draw text");
+	size_t len = strlen(label);
+	uint32_t h = label_hash(label, len);
+	TextCache &c = text_cache[h % TEXT_CACHE];
+	if(c.hash != h || strcmp(c.label, label)) {
+		c.hash = h;
+		snprintf(c.label, sizeof(c.label), "%s", label);
+		c.ti.nchars = utf8toXChar2b(c.ti.text, 254, label, len);
+		c.ti.delta = 0;
+		text_misses++;
+	} else {
+		text_hits++;
+	}
+	xsrv->poly_text_16(bar_pix, fontgc, x, y, c.ti.nchars * 2 + 2,
+					(const uint8_t*)&c.ti);
 }
 
 xcb_gcontext_t Wm::get_font_gc(const char *font_name) {
+	map<string, xcb_gcontext_t>::iterator it = font_gcs.find(font_name);
+	if(it != font_gcs.end()) {
+		return it->second;
+	}
 	// get font context
 	xcb_font_t font = xcb_generate_id(conn);
 	xcb_void_cookie_t font_cookie = xcb_open_font_checked(conn,
 			font, strlen(font_name), font_name);
-	check_cookie(font_cookie, "can't open font");
+	check_later(font_cookie, "can't open font");
 	// create graphics context
 	xcb_gcontext_t fontgc = xcb_generate_id(conn);
 	{
@@ -168,69 +293,104 @@ xcb_gcontext_t Wm::get_font_gc(const char *font_name) {
 			screen->black_pixel, font};
 		xcb_void_cookie_t gc_cookie = xcb_create_gc_checked(conn,
 			fontgc, rootwin, mask, value_list);
-		check_cookie(gc_cookie, "can't create font gc");
+		check_later(gc_cookie, "can't create font gc");
 	}
-	// close font
+	// close font, the gc keeps it loaded
 	font_cookie = xcb_close_font_checked(conn, font);
-	check_cookie(font_cookie, "Can't close font");
+	check_later(font_cookie, "Can't close font");
+	font_gcs[font_name] = fontgc;
 	return fontgc;
 }
 
-void Wm::set_cursor(xcb_screen_t *screen, xcb_window_t window, int cur_id) {
-	xcb_font_t font = xcb_generate_id(conn);
-	xcb_void_cookie_t font_cookie = xcb_open_font_checked(
-				conn, font, strlen("cursor"), "cursor");
-	check_cookie(font_cookie, "can't open font");
-	xcb_cursor_t cursor = xcb_generate_id(conn);
-	xcb_create_glyph_cursor(conn, cursor, font, font, cur_id, cur_id + 1,
-		0, 0, 0, 52428, 52428, 26214);
-	xcb_gcontext_t gc = xcb_generate_id(conn);
-	uint32_t mask = XCB_GC_FOREGROUND | XCB_GC_BACKGROUND | XCB_GC_FONT;
-	uint32_t values_list[3];
-	values_list[0] = screen->white_pixel;
-	values_list[1] = screen->black_pixel;
-	values_list[2] = font;
-	xcb_void_cookie_t gc_cookie = xcb_create_gc_checked(
-				conn, gc, window, mask, values_list);
-	check_cookie(gc_cookie, "Can't create gc");
-	mask = XCB_CW_CURSOR;
-	uint32_t value_list = cursor;
-	xcb_change_window_attributes(conn, window, mask, &value_list);
-	xcb_free_cursor(conn, cursor);
-	xcb_close_font(conn, font);
+xcb_cursor_t Wm::get_cursor(uint16_t cur_id) {
+	map<uint16_t, xcb_cursor_t>::iterator it = cursors.find(cur_id);
+	if(it != cursors.end()) {
+		return it->second;
+	}
+	xcb_cursor_t cursor = xsrv->generate_id();
+	xsrv->create_glyph_cursor(cursor, cursor_font, cur_id);
+	cursors[cur_id] = cursor;
+	return cursor;
+}
+
+void Wm::set_cursor(xcb_window_t window, uint16_t cur_id) {
+	uint32_t value_list = get_cursor(cur_id);
+	xsrv->change_window_attributes(window, XCB_CW_CURSOR, &value_list);
+}
+
+void Wm::release() {
+	map<uint16_t, xcb_cursor_t>::iterator c;
+	for(c = cursors.begin(); c != cursors.end(); c++) {
+		xcb_free_cursor(conn, c->second);
+	}
+	cursors.clear();
+	xcb_close_font(conn, cursor_font);
+	map<string, xcb_gcontext_t>::iterator g;
+	for(g = font_gcs.begin(); g != font_gcs.end(); g++) {
+		xcb_free_gc(conn, g->second);
+	}
+	font_gcs.clear();
+	xcb_free_gc(conn, fg);
+	xcb_free_gc(conn, bg);
+	xcb_free_pixmap(conn, bar_pix);
+	free(text_cache);
+	trace.close();
+	ctl.close();
+	loop.close();
+	xcb_flush(conn);
+	xcb_ewmh_connection_wipe(&ewconn);
+	xcb_disconnect(conn);
 }
 
 void Wm::init() {
-	offset_x = 60; // initialize window stacking offsets
-	offset_y = 20;
+	start_ns = now_ns();
+	// the event loop reads these from a signalfd: SIGUSR1 dumps the
+	// statistics, SIGCHLD reaps children, SIGTERM and SIGINT quit.
+	// Blocked before the log starts its thread, which inherits the mask
+	static const int sigs[] = { SIGUSR1, SIGCHLD, SIGTERM, SIGINT };
+	if(!loop.block(sigs, 4)) exit(-2);
 	// set up logging
 	dispname = getenv("DISPLAY");
 	string logfname = "/tmp/wm";
 	logfname.append(dispname);
-	log.open(logfname.c_str());
-	if(!log) {
+	// YWM_LOG_LEVEL: 0=errors .. 3=debug, YWM_LOG_BINARY=1: binary records
+	const char *loglevel = getenv("YWM_LOG_LEVEL");
+	const char *logbinary = getenv("YWM_LOG_BINARY");
+	if(loglevel) log.level = atoi(loglevel);
+	if(!log.open(logfname.c_str(), logbinary && atoi(logbinary))) {
 		exit(-2);
 	}
-	log << "Starting ywm\n" << flush;
+	log.info("Starting ywm");
+	const char *tracefname = getenv("YWM_TRACE");
+	if(tracefname && !trace.open_write(tracefname)) {
+		log.warn("Can't write trace %s", tracefname);
+	}
 	// connect and get the root window
 	conn = xcb_connect(NULL, &mainscreen);
 	if(xcb_connection_has_error(conn)) exit(1);
 	screen = xcb_setup_roots_iterator(xcb_get_setup(conn)).data;
 	rootwin = screen->root;
-	wm_protocols = getatom((char *)&"WM_PROTOCOLS");
-	wm_delete_window = getatom((char *)&"WM_DELETE_WINDOW");
-
+	xcbx.conn = conn;
+	xcbx.ewconn = &ewconn;
+	xcbx.screen = mainscreen;
+	xsrv = &xcbx;
+	// all requests are sent first, replies and errors are collected at
+	// the end, so startup waits for the server only once
+	xcb_intern_atom_cookie_t protocols_cookie = xcb_intern_atom(conn, 0,
+				strlen("WM_PROTOCOLS"), "WM_PROTOCOLS");
+	xcb_intern_atom_cookie_t delete_cookie = xcb_intern_atom(conn, 0,
+				strlen("WM_DELETE_WINDOW"), "WM_DELETE_WINDOW");
 	xcb_intern_atom_cookie_t *ewmhcookie =
 					xcb_ewmh_init_atoms(conn, &ewconn);
-	if(!xcb_ewmh_init_atoms_replies(&ewconn,
-					ewmhcookie, NULL)) exit(-2);
 
 	// define foreground and background colors
 	fg = xcb_generate_id(conn);
 	{
+		// also used to copy the bar, so no GraphicsExpose/NoExpose
 		uint32_t mask = XCB_GC_FOREGROUND |
-						XCB_GC_LINE_STYLE;
-		uint32_t values[2] = {screen->white_pixel, 0};
+						XCB_GC_LINE_STYLE |
+						XCB_GC_GRAPHICS_EXPOSURES;
+		uint32_t values[3] = {screen->white_pixel, 0, 0};
 		xcb_create_gc(conn, fg, rootwin, mask, values);
 	}
 	bg = xcb_generate_id(conn);
@@ -258,9 +418,18 @@ void Wm::init() {
 		XCB_EVENT_MASK_PROPERTY_CHANGE |
 		XCB_EVENT_MASK_VISIBILITY_CHANGE |
 		XCB_EVENT_MASK_EXPOSURE;
-	xcb_change_window_attributes(conn, rootwin, XCB_CW_EVENT_MASK, &evmask);
-	// set default cursor
-	set_cursor(screen, rootwin, 68);
+	check_later(xcb_change_window_attributes_checked(conn, rootwin,
+		XCB_CW_EVENT_MASK, &evmask), "can't select root events");
+	// windows created before this point will not get CreateNotify
+	xcb_query_tree_cookie_t tree_cookie = xcb_query_tree(conn, rootwin);
+	// set default cursor, the others are ready before the first drag
+	cursor_font = xcb_generate_id(conn);
+	check_later(xcb_open_font_checked(conn, cursor_font, strlen("cursor"),
+					"cursor"), "can't open cursor font");
+	set_cursor(rootwin, CUR_NORMAL);
+	get_cursor(CUR_MOVE);
+	get_cursor(CUR_RESIZE);
+	get_cursor(CUR_AUX);
 //	xcb_flush(conn);
 	// button 8 is used for moving windows
 	xcb_grab_button(conn, 0, rootwin, XCB_EVENT_MASK_BUTTON_PRESS |
@@ -286,504 +455,1407 @@ void Wm::init() {
 					XCB_MOD_MASK_1, 22,
 		XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
 
-	opmode = 0; // enter normal mode of operation
-	system("xterm -geometry +1430+18 -e \"tail -f \\\"/tmp/wm$DISPLAY\\\"; "
-		"bash\" &");
-	system("xterm -geometry +0+18 &");
-	system("xterm -geometry +0+338 &");
-	system("xterm -geometry +0+658 &");
-	// avoid zombie processes by ignoring SIGCHILD
-	signal(SIGCHLD, SIG_IGN);
+	// the bar is rendered into a pixmap, start with an empty one
+	bar_pix = xcb_generate_id(conn);
+	xcb_create_pixmap(conn, screen->root_depth, bar_pix, rootwin,
+				screen->width_in_pixels, BAR_H);
+	init_state();
+
+	// now collect the replies
+	wm_protocols = getatom(protocols_cookie);
+	wm_delete_window = getatom(delete_cookie);
+	if(!xcb_ewmh_init_atoms_replies(&ewconn,
+					ewmhcookie, NULL)) exit(-2);
+	_NET_WM_NAME = ewconn._NET_WM_NAME;
+	check_cookies();
+	adopt_windows(tree_cookie);
+	log.info("Started in %lu us",
+			(unsigned long)(now_ns() - start_ns) / 1000);
+
+	// set up before the terminals are started so no child is missed
+	if(!loop.open(xcb_get_file_descriptor(conn))) {
+		log.err("Can't set up the event loop: %s", strerror(errno));
+		log.close();
+		exit(-1);
+	}
+	// YWM_CTL: control socket path, empty for none
+	const char *ctlpath = getenv("YWM_CTL");
+	string ctlname = string("/tmp/ywm-") + dispname + ".sock";
+	if(ctlpath) ctlname = ctlpath;
+	if(!ctlname.empty()) {
+		if(ctl.open(ctlname.c_str()) && loop.watch(ctl.fd())) {
+			log.info("Control socket %s", ctlname.c_str());
+		} else {
+			log.warn("Can't open control socket %s: %s",
+				ctlname.c_str(), strerror(errno));
+		}
+	}
+	// YWM_AUTOSTART=0: no terminals, e.g. for benchmarks
+	const char *autostart = getenv("YWM_AUTOSTART");
+	if(!autostart || atoi(autostart)) {
+		string logname = string("/tmp/wm") + dispname;
+		const char *logterm[] = { "xterm", "-geometry", "+1430+18",
+			"-e", "sh", "-c", "tail -f \"$0\"; bash",
+			logname.c_str(), NULL };
+		const char *term1[] = { "xterm", "-geometry", "+0+18", NULL };
+		const char *term2[] = { "xterm", "-geometry", "+0+338", NULL };
+		const char *term3[] = { "xterm", "-geometry", "+0+658", NULL };
+		launch(logterm);
+		launch(term1);
+		launch(term2);
+		launch(term3);
+	}
+	fill_pool();
 	draw();
+	flush();
+}
+
+void Wm::init_state() {
+	opmode = 0; // enter normal mode of operation
+	dragging = false;
+	focuswin = focus_pending = XCB_NONE;
+	nfocus = nfocus_skipped = 0;
+	const char *fdelay = getenv("YWM_FOCUS_DELAY");
+	focus_delay_ns = uint64_t(fdelay? atoi(fdelay): 20) * 1000000;
+	nevents = ncoalesced = nbatches = nflushes = 0;
+	dump_requested = child_exited = false;
+	ndumps = 0;
+	status[0] = lastev[0] = evcount[0] = 0;
+	text_cache = (TextCache *)calloc(TEXT_CACHE, sizeof(TextCache));
+	text_hits = text_misses = 0;
+	// status bar spans the screen, redrawn at most YWM_BAR_FPS times/s
+	bar_w = screen->width_in_pixels;
+	place.init(screen->width_in_pixels, screen->height_in_pixels, BAR_H);
+	const char *poolsize = getenv("YWM_TERM_POOL");
+	pool_size = poolsize? atoi(poolsize): 0;
+	pool_taken_ns = 0;
+	// tiled below the status bar; windows already there are added by
+	// adopt_windows
+	tile.area(0, BAR_H, screen->width_in_pixels,
+				screen->height_in_pixels - BAR_H);
+	tile.set_mode(Tile::parse(getenv("YWM_TILE")));
+	const char *snapdist = getenv("YWM_SNAP"); // pixels, 0 = off
+	snap.dist = snapdist? atoi(snapdist): 0;
+	{
+		xcb_rectangle_t r = { 0, 0, bar_w, BAR_H };
+		xsrv->fill_rectangle(bar_pix, bg, r);
+	}
+	drawn_status[0] = drawn_lastev[0] = drawn_evcount[0] = 0;
+	expose_bar(0, 0, bar_w, BAR_H);
+	bar_drawn_ns = 0;
+	const char *fps = getenv("YWM_BAR_FPS"); // 0 = no limit
+	int bar_fps = fps? atoi(fps): 30;
+	bar_frame_ns = bar_fps > 0? 1000000000 / bar_fps: 0;
+}
+
+// state as after init(), but every request goes to b and nothing to a
+// server: for benchmarks and experiments with FakeX. Not logged, no
+// signal handlers, no terminals
+void Wm::init_fake(Xbackend *b, xcb_screen_t *s) {
+	start_ns = now_ns();
+	dispname = (char *)"fake";
+	conn = NULL;
+	xsrv = b;
+	screen = s;
+	rootwin = s->root;
+	mainscreen = 0;
+	_NET_WM_NAME = 0x10000; // any atom which isn't predefined
+	fg = xsrv->generate_id();
+	bg = xsrv->generate_id();
+	mono1 = xsrv->generate_id();
+	sans1 = xsrv->generate_id();
+	cursor_font = xsrv->generate_id();
+	set_cursor(rootwin, CUR_NORMAL);
+	get_cursor(CUR_MOVE);
+	get_cursor(CUR_RESIZE);
+	get_cursor(CUR_AUX);
+	bar_pix = xsrv->generate_id();
+	init_state();
 }
 
 void Wm::draw() {
-	// clear
-	xcb_rectangle_t clear_rect[1] = {{ 0, 0, 1920, 20 }};
-	xcb_poly_fill_rectangle(conn, rootwin, bg, 1, clear_rect);
-	draw_text(mono1, 0, 10, status);
-	draw_text(sans1, 1200, 10, lastev);
+	if(!bar_dirty()) {
+		return; // nothing changed
+	}
+	uint64_t now = now_ns();
+	if(now - bar_drawn_ns < bar_frame_ns) {
+		return; // too early, bar_timeout() tells when to come back
+	}
+	bar_drawn_ns = now;
+	// the status keeps at least the left 200 pixels and the event
+	// counter the next 200, narrow screens cut the last event short
+	int16_t lastev_x = max(int(bar_w) - 720, min(int(bar_w), 400));
+	int16_t evcount_x = max(int(lastev_x) - 200, min(int(lastev_x), 200));
+	draw_field(mono1, 0, evcount_x, status, drawn_status);
+	draw_field(sans1, evcount_x, lastev_x, evcount, drawn_evcount);
+	draw_field(sans1, lastev_x, bar_w, lastev, drawn_lastev);
 //	xcb_image_text_8_checked(conn, strlen(status),
 //					rootwin, sans1, 0, 10, status);
 //	xcb_image_text_8_checked(conn, strlen(lastev),
 //					rootwin, sans1, 200, 10, lastev);
-	xcb_flush(conn);
 }
 
-void Wm::enter_move() {
-	opmode = 1;
-	switch(child_pid = vfork()) {
-	case -1:
-		exit(-1);
-	case 0: { // child
-		char *newargv[] = { (char*)&"y_move", winstr, NULL };
-		execve("/usr/bin/y_move", newargv, envp);
-		exit(-1); // should never get here
+// re-render one part of the bar [x, x1) in the pixmap if its text changed,
+// and copy only that part to the screen. The text is clipped to the field:
+// what sticks out would stay on the next one until that is redrawn
+void Wm::draw_field(xcb_gcontext_t fontgc, int16_t x, int16_t x1,
+					const char *text, char *drawn) {
+	if(!strcmp(text, drawn)) return;
+	strcpy(drawn, text); // also when there is no room, or bar_dirty()
+	if(x1 <= x) return; // would stay true for good
+	xcb_rectangle_t r = { x, 0, uint16_t(x1 - x), BAR_H };
+	xsrv->fill_rectangle(bar_pix, bg, r);
+	xsrv->set_clip(fontgc, &r);
+	draw_text(fontgc, x, 10, text);
+	xsrv->set_clip(fontgc, NULL); // the gc is shared by font name
+	expose_bar(x, 0, x1 - x, BAR_H);
+}
+
+// copy the part of the bar which intersects the given area of the root
+void Wm::expose_bar(int16_t x, int16_t y, uint16_t w, uint16_t h) {
+	int16_t x1 = min(int(x + w), int(bar_w));
+	int16_t y1 = min(int(y + h), int(BAR_H));
+	x = max(x, int16_t(0));
+	y = max(y, int16_t(0));
+	if(x1 <= x || y1 <= y) return;
+	xsrv->copy_area(bar_pix, rootwin, fg, x, y, x, y, x1 - x, y1 - y);
+}
+
+bool Wm::bar_dirty() {
+	return strcmp(status, drawn_status) ||
+				strcmp(lastev, drawn_lastev) ||
+				strcmp(evcount, drawn_evcount);
+}
+
+void Wm::focus_later(xcb_window_t w) {
+	if(focus_pending != XCB_NONE) nfocus_skipped++; // superseded
+	if(w == focuswin) { // back on the focused window, nothing to do
+		focus_pending = XCB_NONE;
+		return;
 	}
+	focus_pending = w;
+	focus_due_ns = now_ns() + focus_delay_ns;
+}
+
+void Wm::apply_focus() {
+	if(focus_pending == XCB_NONE || now_ns() < focus_due_ns) return;
+	xcb_window_t w = focus_pending;
+	focus_pending = XCB_NONE;
+	xsrv->set_input_focus(w);
+	focuswin = w;
+	nfocus++;
+	// a title which is still on its way is shown by collect_titles()
+	snprintf(status, 1023, "%s", get_title(w));
+	log.debug("Focus on window %u '%s'", w, status);
+}
+
+int Wm::focus_timeout() {
+	if(focus_pending == XCB_NONE) return -1;
+	uint64_t now = now_ns();
+	if(now >= focus_due_ns) return 0;
+	return (focus_due_ns - now + 999999) / 1000000;
+}
+
+int Wm::bar_timeout() {
+	if(!bar_dirty()) {
+		return -1;
 	}
+	uint64_t since = now_ns() - bar_drawn_ns;
+	if(since >= bar_frame_ns) return 0;
+	return (bar_frame_ns - since + 999999) / 1000000;
 }
 
-void Wm::enter_resize() {
-	opmode = 2;
-	switch(child_pid = vfork()) {
-	case -1:
-		exit(-1);
-	case 0: { // child
-		char *newargv[] = { (char*)&"y_resize", winstr, NULL };
-		execve("/usr/bin/y_resize", newargv, envp);
-		exit(-1); // should never get here
+void Wm::get_wgeom() {
+	// ConfigureNotify keeps wdata up to date, so usually there is no need
+	// to ask the server; fullscreen windows keep their old geometry there
+	Wdata *it = wdata.find(win);
+	if(it && !(it->flag & 2)) {
+		Wdata &wd = *it;
+		wgeom[0] = wd.x; wgeom[1] = wd.y;
+		wgeom[2] = wd.w; wgeom[3] = wd.h;
+		return;
+	}
+	if(!xsrv->get_geometry(win, wgeom)) {
+		wgeom[0] = wgeom[1] = 0;
+		wgeom[2] = wgeom[3] = 1;
 	}
+}
+
+// both modes are re-anchored at the current pointer position and window
+// geometry, so switching between them does not make the window jump
+void Wm::enter_move(int16_t px, int16_t py) {
+	if(opmode == OP_RESIZE) { // back from resizing
+		xsrv->change_active_pointer_grab(get_cursor(CUR_MOVE),
+							DRAG_EVENTS);
 	}
+	opmode = OP_MOVE;
+	dragging = true;
+	drag.start(px, py, wgeom[0], wgeom[1], wgeom[2], wgeom[3]);
+	snap_start();
+}
+
+void Wm::enter_resize(int16_t px, int16_t py) {
+	xsrv->change_active_pointer_grab(get_cursor(CUR_RESIZE), DRAG_EVENTS);
+	opmode = OP_RESIZE;
+	dragging = true;
+	drag.start(px, py, wgeom[0], wgeom[1], wgeom[2], wgeom[3]);
+	snap_start();
+}
+
+// the other windows hardly move during a drag, so their edges are sorted
+// once here and every motion event only searches them. Override-redirect
+// windows (menus, tooltips) and fullscreen ones are not snapped to
+void Wm::snap_start() {
+	if(!snap.dist) return;
+	snap.clear(screen->width_in_pixels, screen->height_in_pixels, BAR_H);
+	for(Wdata &wd: wdata) {
+		if(wd.window != win && (wd.flag & 7) == 4) {
+			snap.add(wd.x, wd.y, wd.w, wd.h);
+		}
+	}
+	snap.build();
+}
+
+void Wm::drag_motion(int16_t px, int16_t py) {
+	if(!dragging) return;
+	uint32_t values[4];
+	switch(opmode) {
+	case OP_MOVE: {
+		drag.move(px, py, values);
+		int16_t x = values[0], y = values[1];
+		snap.move(x, y, wgeom[2], wgeom[3]);
+		if(x == wgeom[0] && y == wgeom[1]) return;
+		wgeom[0] = values[0] = x; wgeom[1] = values[1] = y;
+		xsrv->configure_window(win,
+			XCB_CONFIG_WINDOW_X |
+			XCB_CONFIG_WINDOW_Y, values);
+		break;
+	}
+	case OP_RESIZE: {
+		if(!drag.resize(px, py, values)) return;
+		int16_t x = values[0], y = values[1];
+		uint16_t w = values[2], h = values[3];
+		snap.resize(x, y, w, h);
+		wgeom[0] = values[0] = x; wgeom[1] = values[1] = y;
+		wgeom[2] = values[2] = w; wgeom[3] = values[3] = h;
+		xsrv->configure_window(win,
+			XCB_CONFIG_WINDOW_X |
+			XCB_CONFIG_WINDOW_Y |
+			XCB_CONFIG_WINDOW_WIDTH |
+			XCB_CONFIG_WINDOW_HEIGHT, values);
+		break;
+	}
+	default:
+		return;
+	}
+}
+
+void Wm::launch(const char *const *argv) {
+	if(launcher.spawn(argv, environ, now_ns()) < 0) {
+		log.warn("Can't start %s", argv[0]);
+	}
+}
+
+// pool terminals are created right outside the bottom right corner of the
+// screen, which is how their MapNotify tells them apart from other windows.
+// Launches that never show up are given up on after 30 s
+void Wm::fill_pool() {
+	uint64_t now = now_ns();
+	while(!pool_starting.empty() &&
+			now - pool_starting[0] > 30000000000ull) {
+		pool_starting.erase(pool_starting.begin());
+	}
+	char geom[32];
+	snprintf(geom, sizeof(geom), "+%u+%u", screen->width_in_pixels,
+						screen->height_in_pixels);
+	const char *term[] = { "xterm", "-geometry", geom, NULL };
+	while(term_pool.size() + pool_starting.size() < pool_size) {
+		// recognized by position, not matched to launches in order
+		if(launcher.spawn(term, environ, now, false) < 0) {
+			log.warn("Can't start %s", term[0]);
+			return;
+		}
+		pool_starting.push_back(now);
+	}
+}
+
+// a terminal from the pool is moved to where it covers the least and
+// mapped, one configure and one map request; the pool is refilled in the
+// background. Without a ready one a new terminal is started
+void Wm::new_terminal() {
+	Wdata *wd = NULL;
+	while(!term_pool.empty() && !wd) {
+		wd = wdata.find(term_pool.back());
+		term_pool.pop_back();
+	}
+	if(wd) {
+		int16_t x = wd->x, y = wd->y; // tiling places it on map
+		if(!tile.mode) place.find(wd->w, wd->h, x, y);
+		uint32_t values[3] = { uint32_t(x), uint32_t(y),
+						XCB_STACK_MODE_ABOVE };
+		xsrv->configure_window(wd->window, XCB_CONFIG_WINDOW_X |
+			XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_STACK_MODE,
+			values);
+		xsrv->map_window(wd->window);
+		pool_taken_ns = now_ns();
+	} else {
+		const char *term[] = { "xterm", NULL };
+		launch(term);
+	}
+	fill_pool();
+}
+
+void Wm::raise_window(xcb_window_t w) {
+	uint32_t values[1] = { XCB_STACK_MODE_ABOVE };
+	xsrv->configure_window(w, XCB_CONFIG_WINDOW_STACK_MODE, values);
+	stack.raise(w); // ConfigureNotify will confirm
+}
+
+void Wm::focus_window(xcb_window_t w) {
+	// ewmh way of doing that:
+	xsrv->set_active_window(w);
+	// set input focus to this window
+	xsrv->set_input_focus(w);
+	focuswin = w;
+	focus_pending = XCB_NONE;
+}
+
+// full screen keeps the old geometry in wdata, ConfigureNotify leaves it
+// alone while the flag is set
+void Wm::toggle_fullscreen(xcb_window_t w) {
+	Wdata *it = wdata.find(w);
+	if(!it) {
+		return; // not in our database
+	}
+	Wdata &wd = *it;
+	uint32_t values[4];
+	if(wd.flag & 2) { // already full scr
+		values[0] = wd.x;
+		values[1] = wd.y;
+		values[2] = wd.w;
+		values[3] = wd.h;
+		wd.flag &= ~2;
+		tile.reset(w); // the layout may have changed meanwhile
+	} else {
+		values[0] = 0;
+		values[1] = 0;
+		values[2] = screen->width_in_pixels;
+		values[3] = screen->height_in_pixels;
+		wd.flag |= 2;
+	}
+	xsrv->configure_window(w, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
+		XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, values);
+}
+
+void Wm::close_window(xcb_window_t w) {
+	xcb_client_message_event_t oev;
+	oev.response_type = XCB_CLIENT_MESSAGE;
+	oev.format = 32;
+	oev.sequence = 0;
+	oev.type = wm_protocols;
+	oev.window = w;
+	oev.data.data32[0] = wm_delete_window;
+	oev.data.data32[1] = XCB_CURRENT_TIME;
+
+	xsrv->send_event(w, (char *) &oev);
+}
+
+// switching tiling on takes in the mapped windows bottom first, switching
+// it off leaves them where they are
+void Wm::set_tiling(int mode) {
+	tile.set_mode(mode);
+	if(mode == Tile::OFF) {
+		while(tile.size()) tile.remove(tile[0].window);
+		return;
+	}
+	for(uint32_t i = 0; i < stack.size(); i++) {
+		Wdata *wd = wdata.find(stack[i].window);
+		if(wd && (wd->flag & 7) == 4) tile.add(wd->window);
+	}
+}
+
+// the configure requests of a whole re-layout go out with the rest of the
+// batch in one flush. Full screen windows keep their place in the layout
+// but are left alone, tile.reset brings them back when they return
+void Wm::apply_layout() {
+	tile.layout(tile_changed);
+	for(size_t i = 0; i < tile_changed.size(); i++) {
+		Tile::Geom &g = tile_changed[i];
+		Wdata *wd = wdata.find(g.window);
+		if(!wd || (wd->flag & 2)) continue;
+		uint32_t values[4] = { uint32_t(g.x), uint32_t(g.y), g.w, g.h };
+		xsrv->configure_window(g.window, XCB_CONFIG_WINDOW_X |
+			XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH |
+			XCB_CONFIG_WINDOW_HEIGHT, values);
+	}
+}
+
+// a tiled window was moved or resized by hand: it goes back to its place,
+// except that resizing the master window sets the master width
+void Wm::tile_dropped() {
+	if(!tile.has(win)) return;
+	if(tile.mode == Tile::MASTER && tile.size() > 1 &&
+				tile[0].window == win && wgeom[2] != tile[0].w) {
+		int m = wgeom[2] * 100 / screen->width_in_pixels;
+		tile.master = m < 10? 10: m > 90? 90: m;
+	}
+	tile.reset(win);
 }
 
 void Wm::print_status(const char *s) {
-	xcb_image_text_8_checked(conn, strlen(s), rootwin, mono1, 300, 10, s);
-	xcb_flush(conn);
+	xsrv->image_text_8(rootwin, mono1, 300, 10, s);
+	xsrv->flush();
+}
+
+// xcb_flush and count it
+void Wm::flush() {
+	xsrv->flush();
+	nflushes++;
+}
+
+// the server numbers requests, so a no-op request tells how many were sent
+void Wm::dump_stats() {
+	unsigned int seq = xsrv->no_operation();
+	ndumps++;
+	string fname = "/tmp/wm";
+	fname.append(dispname).append(".stats");
+	FILE *f = fopen(fname.c_str(), "w");
+	if(!f) {
+		log.warn("Can't write %s", fname.c_str());
+		return;
+	}
+	fprintf(f, "# uptime_ms %lu\n", (unsigned long)
+				(now_ns() - start_ns) / 1000000);
+	fprintf(f, "# events %lu coalesced %lu batches %lu\n",
+		(unsigned long)nevents, (unsigned long)ncoalesced,
+		(unsigned long)nbatches);
+	fprintf(f, "# requests %u flushes %lu bytes_written %lu\n",
+		seq - ndumps, (unsigned long)nflushes,
+		(unsigned long)xsrv->total_written());
+	fprintf(f, "# windows %u tombstones %u stacked %u log_dropped %lu\n",
+		wdata.size(), wdata.tombstones(), stack.size(),
+		(unsigned long)log.dropped());
+	fprintf(f, "# wakeups %lu timer %lu signals %lu\n",
+		(unsigned long)loop.nwakeups, (unsigned long)loop.ntimer,
+		(unsigned long)loop.nsignals);
+	fprintf(f, "# focus_requests %lu focus_skipped %lu\n",
+		(unsigned long)nfocus, (unsigned long)nfocus_skipped);
+	fprintf(f, "# text_cache hits %lu misses %lu\n",
+		(unsigned long)text_hits, (unsigned long)text_misses);
+	fprintf(f, "# children %u spawn_failed %u term_pool %u starting %u\n",
+		launcher.running(), launcher.failed(),
+		uint32_t(term_pool.size()), uint32_t(pool_starting.size()));
+	for(size_t i = 0; i < launcher.progs.size(); i++) {
+		Launcher::Prog &p = launcher.progs[i];
+		fprintf(f, "# spawn_to_map %s launched %u mapped %u "
+			"avg_us %lu max_us %lu\n", p.name, p.launched,
+			p.mapped, (unsigned long)(p.mapped?
+			p.sum_ns / p.mapped / 1000: 0),
+			(unsigned long)p.max_ns / 1000);
+	}
+	evstats.dump(f);
+	fclose(f);
+	log.info("Statistics written to %s", fname.c_str());
 }
 
+// wait for events, then drain everything already queued into one batch:
+// redundant events are dropped, the rest handled in order, and the bar is
+// redrawn and the connection flushed once for the whole batch
 void Wm::event_loop() {
-	xcb_generic_event_t *ev;
+	xcb_generic_event_t *batch[BATCH_MAX];
 	while(1) {
-		int key = 0;
-		ev = xcb_wait_for_event(conn);
-		if(strlen(lastev) < 100) {
-			snprintf(lastev, 1023, "Events: %s %2d",
-				lastev + 8, ev->response_type & ~0x80);
-		} else {
-			snprintf(lastev, 1023, "Events: %s %2d",
-				lastev + 11, ev->response_type & ~0x80);
-		};
-		draw();
-		switch(ev->response_type & ~0x80) {
-		case XCB_EXPOSE:
-			draw();
-			break;
-		case XCB_KEY_PRESS: {
-			xcb_key_press_event_t *kp =
-				(xcb_key_press_event_t *)ev;
-			key = kp->detail;
-			char s[1024];
-			snprintf(s, 1023, "Key pressed: %d, %d          ",
-				key, kp->state);
-			xcb_image_text_8_checked(conn, strlen(s), rootwin,
-				sans1, 1000, 500, s);
-			xcb_flush(conn);
-			break;
-		}
-		case XCB_KEY_RELEASE: {
-			xcb_key_release_event_t *kr =
-				(xcb_key_release_event_t *)ev;
-			key = kr->detail;
-			if(key == 36 && (kr->state & XCB_MOD_MASK_4)) {
-				system("xterm&");
+		int n = 0;
+		// events xcb has already read don't make the socket readable
+		if(!(batch[n] = xcb_poll_for_event(conn))) {
+			if(xcb_connection_has_error(conn)) {
+				return; // connection to the X server is lost
 			}
-			if(key == 22 && (kr->state & XCB_MOD_MASK_CONTROL |
-							XCB_MOD_MASK_1)) {
-				return; // Ctrl+Alt_Backspace = exit X11
+			// sleep until there is an event or a signal, or a
+			// deferred redraw or focus change is due
+			int timeout = bar_timeout(), ft = focus_timeout();
+			if(ft >= 0 && (timeout < 0 || ft < timeout)) {
+				timeout = ft;
 			}
+			if(timeout) loop.wait(timeout < 0? 0: now_ns() +
+						uint64_t(timeout) * 1000000);
+			else loop.poll();
+			if(!serve()) return;
+			// NULL if only replies came in, collected below
+			batch[n] = xcb_poll_for_event(conn);
+		} else {
+			// busy with X events: a look at the rest in passing
+			loop.poll();
+			if(!serve()) {
+				free(batch[n]);
+				return;
+			}
+		}
+		if(batch[n]) n++;
+		while(n < BATCH_MAX && (batch[n] = xcb_poll_for_event(conn))) {
+			n++;
+		}
+		if(!nevents && n) {
+			log.info("Time to first event: %lu us",
+				(unsigned long)(now_ns() - start_ns) / 1000);
 		}
-		case XCB_BUTTON_PRESS: {
-			xcb_button_press_event_t *bp =
-				(xcb_button_press_event_t *)ev;
-			char s[1024];
-			snprintf(s, 1023, "Button pressed: %d, %d           ",
-					bp->detail, bp->state);
-			xcb_image_text_8_checked(conn, strlen(s), rootwin,
-				sans1, 1000, 500, s);
-			xcb_flush(conn);
-//			print_status("hello");
-
-			switch(bp->detail) {
-			case 2: { // middle mouse button: fullscreen if in move
-				switch(opmode) {
-				case OP_MOVE:
-					kill(child_pid, 9); // quit move/resize
-					win = bp->child;
-					map<int, Wdata>::iterator it;
-					it = wdata.find(win);
-					if(it == wdata.end()) {
-						break; // not in our database
-					}
-					Wdata &wd = it->second;
-					uint32_t values[4];
-					if(wd.flag & 2) { // already full scr
-						values[0] = wd.x;
-						values[1] = wd.y;
-						values[2] = wd.w;
-						values[3] = wd.h;
-						wd.flag &= ~2;
-					} else {
-						values[0] = 0;
-						values[1] = 0;
-						values[2] =
-							screen->width_in_pixels;
-						values[3] =
-						screen->height_in_pixels;
-						wd.flag |= 2;
-					}
-					xcb_configure_window(conn, win,
-					XCB_CONFIG_WINDOW_X |
-					XCB_CONFIG_WINDOW_Y |
-					XCB_CONFIG_WINDOW_WIDTH |
+		if(n && trace.is_open()) trace.write(now_ns(), batch, n);
+		if(!handle_batch(batch, n)) return;
+	}
+}
+
+// control clients and signals found by the last wait() or poll(), false
+// to quit
+bool Wm::serve() {
+	for(size_t i = 0; i < loop.ready.size(); i++) {
+		control(loop.ready[i]);
+	}
+	uint64_t sigs = loop.signals();
+	uint64_t usr1 = uint64_t(1) << SIGUSR1;
+	uint64_t chld = uint64_t(1) << SIGCHLD;
+	if(sigs & usr1) dump_requested = true;
+	if(sigs & chld) child_exited = true;
+	if(sigs & (uint64_t(1) << SIGTERM | uint64_t(1) << SIGINT)) {
+		log.info("Quitting on a signal");
+		return false;
+	}
+	return true;
+}
+
+// coalesce and handle one batch of events, frees them, then redraws and
+// flushes. Shared by the event loop and trace replay
+bool Wm::handle_batch(xcb_generic_event_t **batch, int n) {
+	nevents += n;
+	nbatches += n > 0;
+	ncoalesced += coalesce(batch, n);
+	bool quit = false;
+	for(int i = 0; i < n; i++) {
+		if(!batch[i]) continue; // coalesced into a later event
+		if(!quit) {
+			int mode = opmode == OP_AUX? 3: opmode;
+			uint64_t t0 = now_ns();
+			quit = !handle_event(batch[i]);
+			evstats.record(mode, batch[i]->response_type & ~0x80,
+							now_ns() - t0);
+		}
+		free(batch[i]);
+	}
+	apply_focus();
+	apply_layout();
+	collect_titles();
+	if(n) snprintf(evcount, 63, "batch %2d, coalesced %lu/%lu", n,
+		(unsigned long)ncoalesced, (unsigned long)nevents);
+	draw();
+	flush();
+	if(child_exited) {
+		child_exited = false;
+		launcher.reap();
+	}
+	if(dump_requested) {
+		dump_requested = false;
+		dump_stats();
+		trace.flush(); // so the trace so far can be replayed
+	}
+	return !quit;
+}
+
+// all the commands a client has sent so far are carried out together, the
+// requests (a re-layout after tile included) go out in one flush before the
+// replies are written, so the client sees the result when it reads them.
+// A client that has shut down its end still gets its replies
+void Wm::control(int fd) {
+	if(fd == ctl.fd()) {
+		int c;
+		while((c = ctl.accept()) >= 0) {
+			if(!loop.watch(c)) ctl.drop(c);
+		}
+		return;
+	}
+	if(!ctl.is_client(fd)) return;
+	vector<string> cmds;
+	bool open = ctl.read(fd, cmds);
+	string reply;
+	for(size_t i = 0; i < cmds.size(); i++) {
+		command(cmds[i].c_str(), reply);
+	}
+	if(!cmds.empty()) {
+		apply_layout();
+		flush();
+	}
+	bool sent = ctl.reply(fd, reply);
+	if(!open || !sent) {
+		loop.unwatch(fd);
+		ctl.drop(fd);
+	}
+}
+
+// a window id: decimal, as list prints it, or hex with 0x. A leading 0
+// doesn't make it octal
+static bool parse_window(const char *s, xcb_window_t &w) {
+	if(s[0] < '0' || s[0] > '9') return false;
+	int base = s[0] == '0' && (s[1] == 'x' || s[1] == 'X')? 16: 10;
+	char *end;
+	errno = 0;
+	unsigned long v = strtoul(s, &end, base);
+	if(*end || errno || v > UINT32_MAX) return false;
+	w = v;
+	return true;
+}
+
+// a decimal number in [lo, hi]
+static bool parse_int(const char *s, long lo, long hi, int &v) {
+	char *end;
+	errno = 0;
+	long l = strtol(s, &end, 10);
+	if(end == s || *end || errno || l < lo || l > hi) return false;
+	v = l;
+	return true;
+}
+
+// one command, the reply is appended: data lines if any, then "ok" or
+// "err <reason>". Window ids are decimal or 0x hex, positions must fit in
+// 16 bits and sizes be 1..65535. list and at answer from wdata and the
+// stack, as the server last reported them
+void Wm::command(const char *cmd, string &reply) {
+	char op[16], arg[3][32], line[512];
+	xcb_window_t w = 0;
+	int a = 0, b = 0;
+	int n = sscanf(cmd, "%15s %31s %31s %31s", op, arg[0], arg[1],
+								arg[2]);
+	if(n < 1) return;
+	if(!strcmp(op, "list")) { // window x y w h flags title
+		for(Wdata &wd: wdata) {
+			snprintf(line, sizeof(line), "%u %d %d %u %u %u %s\n",
+				wd.window, wd.x, wd.y, wd.w, wd.h, wd.flag,
+				get_title(wd.window));
+			reply += line;
+		}
+		reply += "ok\n";
+		return;
+	}
+	if(!strcmp(op, "at")) { // topmost mapped window at x y
+		if(n < 3 || !parse_int(arg[0], INT16_MIN, INT16_MAX, a) ||
+				!parse_int(arg[1], INT16_MIN, INT16_MAX, b)) {
+			reply += "err usage: at <x> <y>\n";
+			return;
+		}
+		snprintf(line, sizeof(line), "%u\nok\n", stack.at(a, b));
+		reply += line;
+		return;
+	}
+	if(!strcmp(op, "tile")) { // tile off|master|grid
+		if(n < 2) {
+			reply += "err usage: tile off|master|grid\n";
+			return;
+		}
+		set_tiling(Tile::parse(arg[0]));
+		reply += "ok\n";
+		return;
+	}
+	static const char *ops[] = { "move", "resize", "raise", "focus",
+					"fullscreen", "close", NULL };
+	int i = 0;
+	while(ops[i] && strcmp(op, ops[i])) i++;
+	if(!ops[i]) {
+		reply += "err unknown command\n";
+		return;
+	}
+	if(n < 2 || !parse_window(arg[0], w) || !wdata.find(w)) {
+		reply += "err unknown window\n";
+		return;
+	}
+	if(!strcmp(op, "move") && n == 4 &&
+			parse_int(arg[1], INT16_MIN, INT16_MAX, a) &&
+			parse_int(arg[2], INT16_MIN, INT16_MAX, b)) {
+		uint32_t values[2] = { uint32_t(a), uint32_t(b) };
+		xsrv->configure_window(w, XCB_CONFIG_WINDOW_X |
+					XCB_CONFIG_WINDOW_Y, values);
+	} else if(!strcmp(op, "resize") && n == 4 &&
+			parse_int(arg[1], 1, UINT16_MAX, a) &&
+			parse_int(arg[2], 1, UINT16_MAX, b)) {
+		uint32_t values[2] = { uint32_t(a), uint32_t(b) };
+		xsrv->configure_window(w, XCB_CONFIG_WINDOW_WIDTH |
 					XCB_CONFIG_WINDOW_HEIGHT, values);
-					break;
-				}
+	} else if(!strcmp(op, "raise")) {
+		raise_window(w);
+	} else if(!strcmp(op, "focus")) {
+		focus_window(w);
+	} else if(!strcmp(op, "fullscreen")) {
+		toggle_fullscreen(w);
+	} else if(!strcmp(op, "close")) {
+		close_window(w);
+	} else {
+		reply += "err bad arguments\n";
+		return;
+	}
+	reply += "ok\n";
+}
+
+// feed a trace recorded with YWM_TRACE through handle_batch, at the speed
+// it was recorded or as fast as possible, and print the handling time.
+// Requests still go to the server; what it sends back is thrown away
+void Wm::replay(const char *fname, bool fast) {
+	if(!trace.open_read(fname)) {
+		fprintf(stderr, "Can't read trace %s\n", fname);
+		return;
+	}
+	xcb_generic_event_t *batch[BATCH_MAX];
+	uint64_t ns, first_ns = 0, start = now_ns(), busy_ns = 0;
+	int n;
+	while((n = trace.read(ns, batch, BATCH_MAX)) >= 0) {
+		if(!first_ns) first_ns = ns;
+		if(!fast) { // wait until the batch is due
+			uint64_t due = start + (ns - first_ns);
+			struct timespec ts = { time_t(due / 1000000000),
+						long(due % 1000000000) };
+			while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+								&ts, NULL));
+		}
+		xcb_generic_event_t *ev;
+		while((ev = xcb_poll_for_event(conn))) free(ev);
+		uint64_t t0 = now_ns();
+		bool more = handle_batch(batch, n);
+		busy_ns += now_ns() - t0;
+		if(!more) break;
+	}
+	trace.close();
+	uint64_t wall_ns = now_ns() - start;
+	printf("# replayed %lu events in %lu batches, coalesced %lu\n",
+		(unsigned long)nevents, (unsigned long)nbatches,
+		(unsigned long)ncoalesced);
+	printf("# wall_ms %lu busy_ms %lu ns_per_event %lu\n",
+		(unsigned long)(wall_ns / 1000000),
+		(unsigned long)(busy_ns / 1000000),
+		(unsigned long)(nevents? busy_ns / nevents: 0));
+	evstats.dump(stdout);
+}
+
+// key identifying events which only matter in their latest instance
+static uint64_t coalesce_key(xcb_generic_event_t *ev) {
+	uint8_t type = ev->response_type & ~0x80;
+	xcb_window_t w;
+	switch(type) {
+	case XCB_CONFIGURE_NOTIFY:
+		w = ((xcb_configure_notify_event_t *)ev)->window;
+		break;
+	case XCB_ENTER_NOTIFY:
+		w = ((xcb_enter_notify_event_t *)ev)->event;
+		break;
+	case XCB_EXPOSE:
+		w = ((xcb_expose_event_t *)ev)->window;
+		break;
+	case XCB_MOTION_NOTIFY: // all of them come through the root grab
+		w = 0;
+		break;
+	default:
+		return 0;
+	}
+	return (uint64_t(type) << 32) | w;
+}
+
+// walk the batch backwards and drop every event that is followed by a newer
+// one with the same key; dropped Expose areas are merged into the newer one.
+// Structural events are barriers for their window and button events for
+// motion: nothing is coalesced across them, so MapNotify placement and
+// move/resize switches still see the state they would have seen without
+// batching. A ConfigureNotify is a barrier for those of other windows:
+// restacks don't commute (from A B C, A above C, B above A, A above C
+// gives C A B, the last two alone B C A), so only a run of one window's
+// ConfigureNotify is merged. Returns the number of dropped events
+int Wm::coalesce(xcb_generic_event_t **evs, int n) {
+	uint64_t seen[BATCH_MAX]; // keys of newer events kept so far
+	int seenidx[BATCH_MAX]; // and where in the batch they are
+	int nseen = 0;
+	int dropped = 0;
+	for(int i = n - 1; i >= 0; i--) {
+		uint64_t key = coalesce_key(evs[i]);
+		if(!key) {
+			xcb_window_t w;
+			switch(evs[i]->response_type & ~0x80) {
+			case XCB_BUTTON_PRESS: case XCB_BUTTON_RELEASE:
+				w = 0; // motion
 				break;
-			}
-			case 3: // if moving, enter the resize window mode
-				switch(opmode) {
-				case OP_MOVE:
-					snprintf(status, 1023, "resizing     ");
-					draw();
-					// first, terminate the move mode
-					kill(child_pid, 9); // stop moving win
-					// run the program that binds mouse 2 sz
-					enter_resize();
-					break;
-				case OP_AUX:
-					// run menu app
-					break;
-				}
+			case XCB_CREATE_NOTIFY:
+				w = ((xcb_create_notify_event_t *)
+							evs[i])->window;
 				break;
-			case 4:
-				switch(opmode) {
-				case OP_MOVE: // kill app
-					xcb_kill_client(conn, win);
-					xcb_flush(conn);
-					break;
-				}
+			case XCB_DESTROY_NOTIFY:
+				w = ((xcb_destroy_notify_event_t *)
+							evs[i])->window;
 				break;
-			case 5:
-				switch(opmode) {
-				case OP_MOVE: { // kill app
-					xcb_client_message_event_t oev;
-					oev.response_type = XCB_CLIENT_MESSAGE;
-					oev.format = 32;
-					oev.sequence = 0;
-					oev.type = wm_protocols;
-					oev.window = win;
-					oev.data.data32[0] = wm_delete_window;
-					oev.data.data32[1] = XCB_CURRENT_TIME;
-
-					xcb_send_event(conn, false, win,
-						XCB_EVENT_MASK_NO_EVENT,
-						(char *) &oev);
-					xcb_flush(conn);
-				}
-				}
+			case XCB_MAP_NOTIFY:
+				w = ((xcb_map_notify_event_t *)
+							evs[i])->window;
 				break;
-			case 8: { // enter the move window mode
-				if(opmode) break; // activated from normal mode
-				win = bp->child;
-				snprintf(winstr, 19, "%d", win);
-				xcb_grab_pointer(conn, 0, rootwin,
-					XCB_EVENT_MASK_BUTTON_PRESS |
-					XCB_EVENT_MASK_BUTTON_RELEASE,
-					XCB_GRAB_MODE_ASYNC,
-					XCB_GRAB_MODE_ASYNC,
-					rootwin, XCB_NONE,
-					XCB_CURRENT_TIME);
-				// raise this window first
-				uint32_t values[3] = {XCB_STACK_MODE_ABOVE, 0};
-				xcb_configure_window(conn, win,
-						XCB_CONFIG_WINDOW_STACK_MODE,
-						values);
-				// ewmh way of doing that:
-				xcb_ewmh_request_change_active_window(&ewconn,
-					mainscreen, win,
-					XCB_EWMH_CLIENT_SOURCE_TYPE_OTHER,
-					XCB_CURRENT_TIME, XCB_NONE);
-				// set input focus to this window
-				xcb_set_input_focus(conn,
-					XCB_INPUT_FOCUS_POINTER_ROOT, win,
-					XCB_CURRENT_TIME);
-
-				xcb_flush(conn);
-				// run the program that binds mouse to win pos
-				enter_move();
+			case XCB_UNMAP_NOTIFY:
+				w = ((xcb_unmap_notify_event_t *)
+							evs[i])->window;
 				break;
+			default:
+				continue;
+			}
+			// forget newer events of this window, keep the rest
+			int k = 0;
+			for(int j = 0; j < nseen; j++) {
+				if(xcb_window_t(seen[j]) == w) continue;
+				seen[k] = seen[j];
+				seenidx[k++] = seenidx[j];
 			}
-			case 9: { // enter auxillary mode
-				if(opmode) break; // activated from normal mode
-				opmode = OP_AUX;
+			nseen = k;
+			continue;
+		}
+		int j;
+		for(j = 0; j < nseen && seen[j] != key; j++);
+		if(j == nseen) {
+			if(uint8_t(key >> 32) == XCB_CONFIGURE_NOTIFY) {
+				int k = 0;
+				for(j = 0; j < nseen; j++) {
+					if(uint8_t(seen[j] >> 32) ==
+						XCB_CONFIGURE_NOTIFY) continue;
+					seen[k] = seen[j];
+					seenidx[k++] = seenidx[j];
+				}
+				nseen = k;
+			}
+			seen[nseen] = key;
+			seenidx[nseen++] = i;
+			continue;
+		}
+		if((evs[i]->response_type & ~0x80) == XCB_EXPOSE) {
+			xcb_expose_event_t *o = (xcb_expose_event_t *)evs[i];
+			xcb_expose_event_t *e =
+				(xcb_expose_event_t *)evs[seenidx[j]];
+			int x1 = max(o->x + o->width, e->x + e->width);
+			int y1 = max(o->y + o->height, e->y + e->height);
+			e->x = min(o->x, e->x);
+			e->y = min(o->y, e->y);
+			e->width = x1 - e->x;
+			e->height = y1 - e->y;
+		}
+		free(evs[i]);
+		evs[i] = NULL;
+		dropped++;
+	}
+	return dropped;
+}
+
+// handle a single event, returns false when the window manager should quit
+bool Wm::handle_event(xcb_generic_event_t *ev) {
+	int key = 0;
+	if(strlen(lastev) < 100) {
+		snprintf(lastev, 1023, "Events: %s %2d",
+			lastev + 8, ev->response_type & ~0x80);
+	} else {
+		snprintf(lastev, 1023, "Events: %s %2d",
+			lastev + 11, ev->response_type & ~0x80);
+	};
+	switch(ev->response_type & ~0x80) {
+	case XCB_EXPOSE: { // restore the damaged part of the bar
+		xcb_expose_event_t *e = (xcb_expose_event_t *)ev;
+		if(e->window == rootwin) {
+			expose_bar(e->x, e->y, e->width, e->height);
+		}
+		break;
+	}
+	case XCB_KEY_PRESS: {
+		xcb_key_press_event_t *kp =
+			(xcb_key_press_event_t *)ev;
+		key = kp->detail;
+		char s[1024];
+		snprintf(s, 1023, "Key pressed: %d, %d          ",
+			key, kp->state);
+		xsrv->image_text_8(rootwin, sans1, 1000, 500, s);
+		break;
+	}
+	case XCB_KEY_RELEASE: {
+		xcb_key_release_event_t *kr =
+			(xcb_key_release_event_t *)ev;
+		key = kr->detail;
+		if(key == 36 && (kr->state & XCB_MOD_MASK_4)) {
+			new_terminal();
+		}
+		if(key == 22 && (kr->state & XCB_MOD_MASK_CONTROL |
+						XCB_MOD_MASK_1)) {
+			return false; // Ctrl+Alt_Backspace = exit X11
+		}
+	}
+	case XCB_BUTTON_PRESS: {
+		xcb_button_press_event_t *bp =
+			(xcb_button_press_event_t *)ev;
+		char s[1024];
+		snprintf(s, 1023, "Button pressed: %d, %d           ",
+				bp->detail, bp->state);
+		xsrv->image_text_8(rootwin, sans1, 1000, 500, s);
+//		print_status("hello");
+
+		switch(bp->detail) {
+		case 2: { // middle mouse button: fullscreen if in move
+			switch(opmode) {
+			case OP_MOVE:
+				dragging = false; // quit move/resize
 				win = bp->child;
-				snprintf(winstr, 19, "%d", win);
-				snprintf(status, 1023, "Aux mode: %s          ",
-							winstr);
-
-				xcb_grab_pointer(conn, 0, rootwin,
-					XCB_EVENT_MASK_BUTTON_PRESS |
-					XCB_EVENT_MASK_BUTTON_RELEASE,
-					XCB_GRAB_MODE_ASYNC,
-					XCB_GRAB_MODE_ASYNC,
-					rootwin, XCB_NONE,
-					XCB_CURRENT_TIME);
-
-				// raise this window first
-				uint32_t values[3] = {XCB_STACK_MODE_ABOVE, 0};
-				xcb_configure_window(conn, win,
-						XCB_CONFIG_WINDOW_STACK_MODE,
-						values);
-				// ewmh way of doing that:
-				xcb_ewmh_request_change_active_window(&ewconn,
-					mainscreen, win,
-					XCB_EWMH_CLIENT_SOURCE_TYPE_OTHER,
-					XCB_CURRENT_TIME, XCB_NONE);
-				// set input focus to this window
-				xcb_set_input_focus(conn,
-					XCB_INPUT_FOCUS_POINTER_ROOT, win,
-					XCB_CURRENT_TIME);
-
-				xcb_flush(conn);
+				toggle_fullscreen(win);
+				// a resize from here starts at the new size
+				get_wgeom();
 				break;
 			}
-			}
 			break;
 		}
-		case XCB_BUTTON_RELEASE: {
-			xcb_button_release_event_t *br =
-				(xcb_button_release_event_t *)ev;
+		case 3: // if moving, enter the resize window mode
 			switch(opmode) {
-			case 1: // we are in the move window opreating mode
-				if(br->detail != 8) break; // wrong button
-				opmode = 0; // normal mode of operation
-				xcb_ungrab_pointer(conn, XCB_CURRENT_TIME);
-				xcb_flush(conn);
-				kill(child_pid, 9); // stop moving window
+			case OP_MOVE:
+				snprintf(status, 1023, "resizing     ");
+				// pointer now resizes the window
+				enter_resize(bp->root_x, bp->root_y);
 				break;
-			case 2: // we are in resize window mode
-				if(br->detail == 8) { // cancel, enter normal op
-					opmode = 0; // normal operating mode
-					xcb_ungrab_pointer(conn,
-							XCB_CURRENT_TIME);
-					xcb_flush(conn);
-					kill(child_pid, 9);
-					break;
-				}
-				if(br->detail == 3) { // stop resize, enter move
-					kill(child_pid, 9); // stop resizing
-					// start moving
-					enter_move();
-					break;
-				}
-				break;
-			case OP_AUX: // we are in auxillary mode
-				if(br->detail != 9) break; // wrong button
-				opmode = OP_NORMAL;
-				xcb_ungrab_pointer(conn, XCB_CURRENT_TIME);
-				xcb_flush(conn);
+			case OP_AUX:
+				// run menu app
 				break;
 			}
 			break;
-		}
-		case XCB_CONFIGURE_NOTIFY: {
-			xcb_configure_notify_event_t *e =
-				(xcb_configure_notify_event_t *)ev;
-			map<int, Wdata>::iterator it;
-			it = wdata.find(e->window);
-			if(it == wdata.end()) {
-				//log << "Not in DB" << endl;
-				break; // not in our database
-			}
-			Wdata &wd = it->second;
-			if(wd.flag & 1) {
-				//log << "Override Redirect" << endl;
-				break; // override_redirect flag is on
-			}
-			if(wd.flag & 2) { // window entered full screen mode
+		case 4:
+			switch(opmode) {
+			case OP_MOVE: // kill app
+				xsrv->kill_client(win);
 				break;
 			}
-			wd.x = e->x;
-			wd.y = e->y;
-			wd.w = e->width;
-			wd.h = e->height;
 			break;
-		}
-		case XCB_MAP_NOTIFY: {
-			xcb_map_notify_event_t *e =
-				(xcb_map_notify_event_t *)ev;
-			// check if this window is in our database
-			map<int, Wdata>::iterator it;
-			it = wdata.find(e->window);
-			if(it == wdata.end()) {
-				//log << "Not in DB" << endl;
-				break; // not in our database
-			}
-			Wdata &wd = it->second;
-			if(wd.flag & 1) {
-				//log << "Override Redirect" << endl;
-				break; // override_redirect flag is on
+		case 5:
+			switch(opmode) {
+			case OP_MOVE: // close app
+				close_window(win);
+				break;
 			}
-			// if intended position is 0, 0, but not fullscreen
-			// set position to 60, 30 from top right corner:
-			if(wd.x == 0 && wd.y == 0 &&
-				wd.w < screen->width_in_pixels &&
-				wd.h < screen->height_in_pixels) {
-				wd.x = screen->width_in_pixels - wd.w
-					- offset_x;
-				// simple window stacking scheme:
-				wd.y = offset_y;
-				offset_x += 5;
-				offset_y += 5;
-				if(offset_x > 100) {
-					offset_x = 60;
-				}
-				if(offset_y > 80) {
-					offset_y = 20;
-				}
+			break;
+		case 8: { // enter the move window mode
+			if(opmode) break; // activated from normal mode
+			win = bp->child;
+			if(win == XCB_NONE) break; // nothing to move
+			snprintf(winstr, 19, "%d", win);
+			xsrv->grab_pointer(rootwin, DRAG_EVENTS,
+						get_cursor(CUR_MOVE));
+			// raise this window first, then focus it
+			raise_window(win);
+			focus_window(win);
 
-				uint32_t values[2];
-				values[0] = wd.x; values[1] = wd.y;
-				xcb_configure_window(conn, e->window,
-					XCB_CONFIG_WINDOW_X |
-					XCB_CONFIG_WINDOW_Y, values);
-			}
-			xcb_flush(conn);
-			log << "Map notify: " << e->event << " " << e->window <<
-				endl;
+			// from now on MotionNotify moves the window
+			get_wgeom();
+			enter_move(bp->root_x, bp->root_y);
 			break;
 		}
-		case XCB_CREATE_NOTIFY: {
-			// a new window created, we want to track its
-			// XCB_ENTER_NOTIFY event so that focus follows pointer
-			// but first, let's add it to our tracking list wdata:
-			xcb_create_notify_event_t *e =
-				(xcb_create_notify_event_t *)ev;
-
-			Wdata &wd = wdata[e->window];
-			wd.flag = e->override_redirect & 1;
-			wd.window = e->window;
-			wd.parent = e->parent;
-			wd.x = e->x;
-			wd.y = e->y;
-			wd.w = e->width;
-			wd.h = e->height;
-
-			uint32_t mask = XCB_CW_EVENT_MASK;
-			uint32_t values[2];
-			values[0] = XCB_EVENT_MASK_ENTER_WINDOW;
-			xcb_change_window_attributes_checked(conn, e->window,
-						mask, values);
-			xcb_flush(conn);
-			log << "A window created: " << e->window << " "
-				<< e->parent << " <" <<int(e->override_redirect)
-				<< endl;
+		case 9: { // enter auxillary mode
+			if(opmode) break; // activated from normal mode
+			opmode = OP_AUX;
+			win = bp->child;
+			snprintf(winstr, 19, "%d", win);
+			snprintf(status, 1023, "Aux mode: %s          ",
+						winstr);
+
+			xsrv->grab_pointer(rootwin,
+				XCB_EVENT_MASK_BUTTON_PRESS |
+				XCB_EVENT_MASK_BUTTON_RELEASE,
+				get_cursor(CUR_AUX));
+
+			// raise this window first, then focus it
+			raise_window(win);
+			focus_window(win);
+
 			break;
 		}
-		case XCB_DESTROY_NOTIFY: {
-			xcb_destroy_notify_event_t *e =
-				(xcb_destroy_notify_event_t *)ev;
-			// when a window is destroyed, remove it from our db:
-			map<int, Wdata>::iterator it;
-			it = wdata.find(e->window);
-			if(it == wdata.end()) {
-				wdata.erase(it);
-			}
-			break;
 		}
-		case XCB_ENTER_NOTIFY: {
-			char wname[1024]; // window name
-			wname[0] = 0;
-			xcb_enter_notify_event_t *e =
-				(xcb_enter_notify_event_t *)ev;
-			// don't set focus to root window
-			log << "Trying focus to window '" << wname << "'" <<
-				e->root << " " <<
-				e->event << " " <<
-				e->child << " " << endl;
-
-			if(e->event == rootwin) {
-				//log << "Ignoring root window" << endl;
+		break;
+	}
+	case XCB_BUTTON_RELEASE: {
+		xcb_button_release_event_t *br =
+			(xcb_button_release_event_t *)ev;
+		switch(opmode) {
+		case 1: // we are in the move window opreating mode
+			if(br->detail != 8) break; // wrong button
+			opmode = 0; // normal mode of operation
+			dragging = false; // stop moving window
+			xsrv->ungrab_pointer();
+			tile_dropped();
+			break;
+		case 2: // we are in resize window mode
+			if(br->detail == 8) { // cancel, enter normal op
+				opmode = 0; // normal operating mode
+				dragging = false;
+				xsrv->ungrab_pointer();
+				tile_dropped();
 				break;
 			}
-			// don't set focus to focuswin
-			if(e->event == focuswin) {
-				log << "Already focused, but..." << endl;
-				//break;
+			if(br->detail == 3) { // stop resize, enter move
+				enter_move(br->root_x, br->root_y);
+				break;
 			}
-			// check if this window is in our database
-			map<int, Wdata>::iterator it;
-			it = wdata.find(e->event);
-			if(it == wdata.end()) {
-				log << "Not in DB" << endl;
-				break; // not in our database
+			break;
+		case OP_AUX: // we are in auxillary mode
+			if(br->detail != 9) break; // wrong button
+			opmode = OP_NORMAL;
+			xsrv->ungrab_pointer();
+			break;
+		}
+		break;
+	}
+	case XCB_MOTION_NOTIFY: {
+		xcb_motion_notify_event_t *e =
+			(xcb_motion_notify_event_t *)ev;
+		drag_motion(e->root_x, e->root_y);
+		break;
+	}
+	case XCB_CONFIGURE_NOTIFY: {
+		xcb_configure_notify_event_t *e =
+			(xcb_configure_notify_event_t *)ev;
+		stack.configure(e->window, e->above_sibling, e->x, e->y,
+						e->width, e->height);
+		Wdata *it = wdata.find(e->window);
+		if(!it) {
+			//log.debug("Not in DB");
+			break; // not in our database
+		}
+		Wdata &wd = *it;
+		if(wd.flag & 1) {
+			//log.debug("Override Redirect");
+			break; // override_redirect flag is on
+		}
+		if(wd.flag & 2) { // window entered full screen mode
+			break;
+		}
+		if(wd.flag & 4) place.remove(wd.x, wd.y, wd.w, wd.h);
+		wd.x = e->x;
+		wd.y = e->y;
+		wd.w = e->width;
+		wd.h = e->height;
+		if(wd.flag & 4) place.add(wd.x, wd.y, wd.w, wd.h);
+		break;
+	}
+	case XCB_MAP_NOTIFY: {
+		xcb_map_notify_event_t *e =
+			(xcb_map_notify_event_t *)ev;
+		stack.mapped(e->window, true);
+		// check if this window is in our database
+		Wdata *it = wdata.find(e->window);
+		if(!it) {
+			//log.debug("Not in DB");
+			break; // not in our database
+		}
+		Wdata &wd = *it;
+		if(wd.flag & 1) {
+			//log.debug("Override Redirect");
+			break; // override_redirect flag is on
+		}
+		if(wd.flag & 4) break; // already mapped
+		if(pool_size && !(wd.flag & 8) &&
+				wd.x == screen->width_in_pixels &&
+				wd.y == screen->height_in_pixels) {
+			// a new pool terminal: put it away until it is needed
+			xsrv->unmap_window(e->window);
+			wd.flag |= 8;
+			term_pool.push_back(e->window);
+			if(!pool_starting.empty()) {
+				pool_starting.erase(pool_starting.begin());
 			}
-			Wdata &wd = it->second;
-			if(wd.flag & 1) {
-				//log << "Override Redirect" << endl;
-				break; // override_redirect flag is on
+			break;
+		}
+		// if intended position is 0, 0, but not fullscreen, put it
+		// where it covers the least of the other windows, top right
+		// if there is a choice
+		if(tile.mode) {
+			tile.add(e->window); // placed by apply_layout
+		} else if(wd.x == 0 && wd.y == 0 &&
+			wd.w < screen->width_in_pixels &&
+			wd.h < screen->height_in_pixels) {
+			place.find(wd.w, wd.h, wd.x, wd.y);
+			uint32_t values[2];
+			values[0] = wd.x; values[1] = wd.y;
+			xsrv->configure_window(e->window,
+				XCB_CONFIG_WINDOW_X |
+				XCB_CONFIG_WINDOW_Y, values);
+		}
+		wd.flag |= 4;
+		place.add(wd.x, wd.y, wd.w, wd.h);
+		log.debug("Map notify: %u %u", e->event, e->window);
+		const char *prog;
+		if(wd.flag & 8) { // taken from the pool
+			log.info("pool terminal mapped %u after %lu us",
+				e->window, (unsigned long)
+				(now_ns() - pool_taken_ns) / 1000);
+			wd.flag &= ~8;
+		} else if(uint64_t dt = launcher.mapped(now_ns(), &prog)) {
+			log.info("%s mapped %u after %lu us", prog, e->window,
+						(unsigned long)dt / 1000);
+		}
+		break;
+	}
+	case XCB_UNMAP_NOTIFY: {
+		xcb_unmap_notify_event_t *e =
+			(xcb_unmap_notify_event_t *)ev;
+		stack.mapped(e->window, false);
+		tile.remove(e->window);
+		Wdata *it = wdata.find(e->window);
+		if(it && (it->flag & 4)) {
+			place.remove(it->x, it->y, it->w, it->h);
+			it->flag &= ~4;
+		}
+		break;
+	}
+	case XCB_CREATE_NOTIFY: {
+		// a new window created, we want to track its
+		// XCB_ENTER_NOTIFY event so that focus follows pointer
+		// but first, let's add it to our tracking list wdata:
+		xcb_create_notify_event_t *e =
+			(xcb_create_notify_event_t *)ev;
+		track_window(e->window, e->parent, e->override_redirect,
+				e->x, e->y, e->width, e->height);
+		stack.add(e->window, e->x, e->y, e->width, e->height);
+		log.debug("A window created: %u %u <%d windows: %u live, "
+			"%u removed", e->window, e->parent,
+			int(e->override_redirect), wdata.size(),
+			wdata.tombstones());
+		break;
+	}
+	case XCB_DESTROY_NOTIFY: {
+		xcb_destroy_notify_event_t *e =
+			(xcb_destroy_notify_event_t *)ev;
+		// when a window is destroyed, remove it from our db:
+		forget_title(e->window);
+		stack.remove(e->window);
+		tile.remove(e->window);
+		if(focus_pending == e->window) focus_pending = XCB_NONE;
+		Wdata *it = wdata.find(e->window);
+		if(it && (it->flag & 4)) {
+			place.remove(it->x, it->y, it->w, it->h);
+		}
+		if(it && (it->flag & 8)) { // a pool terminal went away
+			for(size_t i = 0; i < term_pool.size(); i++) {
+				if(term_pool[i] == e->window) {
+					term_pool.erase(term_pool.begin() + i);
+					fill_pool();
+					break;
+				}
 			}
-			// update window title display:
-			size_t len = get_window_name(e->event, wname, 1024);
-			snprintf(status, 1023, "%s",
-				wname, e->root, e->event, e->child);
-			// set input focus to this window
-			xcb_set_input_focus(conn,
-					XCB_INPUT_FOCUS_POINTER_ROOT, e->event,
-					XCB_CURRENT_TIME);
-			draw(); // draw() flushes for us, no need for xcb_flush
-
-			focuswin = e->event;
-
-			log << "Setting focus to window '" << wname << "'" <<
-				e->root << " " <<
-				e->event << " " <<
-				e->child << " " << wd.flag << " " <<
-				len << endl;
+		}
+		if(wdata.erase(e->window)) {
+			log.debug("A window destroyed: %u windows: %u live, "
+				"%u removed", e->window, wdata.size(),
+				wdata.tombstones());
+		}
+		break;
+	}
+	case XCB_CIRCULATE_NOTIFY: {
+		xcb_circulate_notify_event_t *e =
+			(xcb_circulate_notify_event_t *)ev;
+		if(e->place == XCB_PLACE_ON_TOP) stack.raise(e->window);
+		else stack.lower(e->window);
+		break;
+	}
+	case XCB_PROPERTY_NOTIFY: {
+		xcb_property_notify_event_t *e =
+			(xcb_property_notify_event_t *)ev;
+		// keep the title cache of tracked windows up to date
+		if((e->atom == _NET_WM_NAME ||
+				e->atom == XCB_ATOM_WM_NAME) &&
+				titles.find(e->window)) {
+			request_title(e->window);
+		}
+		break;
+	}
+	case XCB_ENTER_NOTIFY: {
+		xcb_enter_notify_event_t *e =
+			(xcb_enter_notify_event_t *)ev;
+		// don't set focus to root window
+		log.debug("Trying focus to window %u %u %u", e->root,
+						e->event, e->child);
 
+		if(e->event == rootwin) {
+			//log.debug("Ignoring root window");
 			break;
 		}
+		// check if this window is in our database
+		Wdata *it = wdata.find(e->event);
+		if(!it) {
+			log.debug("Not in DB");
+			break; // not in our database
 		}
+		Wdata &wd = *it;
+		if(wd.flag & 1) {
+			//log.debug("Override Redirect");
+			break; // override_redirect flag is on
+		}
+		// focused when the pointer stays, see apply_focus()
+		focus_later(e->event);
+		break;
+	}
 	}
+	return true;
+}
+
+Wdata &Wm::track_window(xcb_window_t w, xcb_window_t parent,
+		uint8_t override_redirect, int16_t x, int16_t y,
+		uint16_t width, uint16_t height) {
+	Wdata &wd = wdata.insert(w);
+	wd.flag = override_redirect & 1;
+	wd.window = w;
+	wd.parent = parent;
+	wd.x = x;
+	wd.y = y;
+	wd.w = width;
+	wd.h = height;
+
+	uint32_t mask = XCB_CW_EVENT_MASK;
+	uint32_t values[2];
+	values[0] = XCB_EVENT_MASK_ENTER_WINDOW |
+			XCB_EVENT_MASK_PROPERTY_CHANGE; // title changes
+	xsrv->change_window_attributes(w, mask, values);
+	if(!wd.flag) request_title(w);
+	return wd;
 }
 
-size_t Wm::get_window_name(xcb_window_t win, char *buf, size_t len) {
-	xcb_get_property_cookie_t cookie;
-	xcb_get_property_reply_t *reply;
-//	xcb_atom_t property = XCB_ATOM_WM_NAME;
-	xcb_atom_t property = ewconn._NET_WM_NAME;
-//	xcb_atom_t type = XCB_ATOM_STRING;
-	xcb_atom_t type = XCB_ATOM_ANY;
-	size_t length;
-	cookie = xcb_get_property(conn, 0, win, property, type, 0, 200);
-	if((reply = xcb_get_property_reply(
-			conn, cookie, NULL))) {
-		length = xcb_get_property_value_length(reply);
-		if(length != 0) {
-			length = (length >= len)? len: length;
-			strncpy(buf,
-				(char *)xcb_get_property_value(reply), length);
-			buf[length] = '\0';
-			free(reply);
-			return length + 1;
+// after a restart the windows are already there: ask for attributes and
+// geometry of all of them at once, then collect the replies
+void Wm::adopt_windows(xcb_query_tree_cookie_t tree_cookie) {
+	uint64_t t0 = now_ns();
+	xcb_query_tree_reply_t *tree = xcb_query_tree_reply(conn,
+						tree_cookie, NULL);
+	if(!tree) return;
+	xcb_window_t *children = xcb_query_tree_children(tree);
+	int n = xcb_query_tree_children_length(tree);
+	vector<xcb_get_window_attributes_cookie_t> attr_cookies(n);
+	vector<xcb_get_geometry_cookie_t> geom_cookies(n);
+	for(int i = 0; i < n; i++) {
+		attr_cookies[i] = xcb_get_window_attributes(conn, children[i]);
+		geom_cookies[i] = xcb_get_geometry(conn, children[i]);
+	}
+	int adopted = 0;
+	for(int i = 0; i < n; i++) {
+		xcb_get_window_attributes_reply_t *attr =
+			xcb_get_window_attributes_reply(conn,
+						attr_cookies[i], NULL);
+		xcb_get_geometry_reply_t *geom = xcb_get_geometry_reply(conn,
+						geom_cookies[i], NULL);
+		if(attr && geom) { // both NULL if the window is gone
+			Wdata &wd = track_window(children[i], rootwin,
+				attr->override_redirect, geom->x, geom->y,
+				geom->width, geom->height);
+			bool viewable = attr->map_state !=
+						XCB_MAP_STATE_UNMAPPED;
+			// query_tree lists them bottom first
+			stack.add(wd.window, wd.x, wd.y, wd.w, wd.h);
+			stack.mapped(wd.window, viewable);
+			if(!wd.flag && viewable) {
+				wd.flag |= 4;
+				place.add(wd.x, wd.y, wd.w, wd.h);
+				if(tile.mode) tile.add(wd.window);
+			}
+			adopted++;
 		}
-		free(reply);
+		free(attr);
+		free(geom);
+	}
+	free(tree);
+	log.info("Adopted %d windows in %lu us", adopted,
+				(unsigned long)(now_ns() - t0) / 1000);
+}
+
+// ask for both name properties at once; replies are picked up later by
+// collect_titles() so the event loop never waits for them
+void Wm::request_title(xcb_window_t w) {
+	Wtitle &t = titles.insert(w);
+	for(int i = 0; i < 2; i++) {
+		if(t.seq[i]) xsrv->discard_reply(t.seq[i]);
+	}
+	t.seq[0] = xsrv->get_property(w, _NET_WM_NAME, sizeof(t.name) / 4);
+	t.seq[1] = xsrv->get_property(w, XCB_ATOM_WM_NAME, sizeof(t.name) / 4);
+	title_pending.push_back(w);
+}
+
+// copy the property value of a reply (NULL on error) into the title,
+// returns false if the property is empty or missing
+static bool take_title(Wtitle &t, xcb_get_property_reply_t *reply) {
+	if(!reply) return false;
+	size_t length = xcb_get_property_value_length(reply);
+	if(length != 0) {
+		length = min(length, sizeof(t.name) - 1);
+		memcpy(t.name, xcb_get_property_value(reply), length);
+		t.name[length] = '\0';
 	}
-	// length is zero, try another way to get window name
-	property = XCB_ATOM_WM_NAME;
-	cookie = xcb_get_property(conn, 0, win, property, type, 0, 200);
-	if((reply = xcb_get_property_reply(
-			conn, cookie, NULL))) {
-		length = xcb_get_property_value_length(reply);
-		if(length != 0) {
-			length = (length >= len)? len: length;
-			strncpy(buf,
-				(char *)xcb_get_property_value(reply), length);
-			buf[length] = '\0';
-			free(reply);
-			return length + 1;
+	free(reply);
+	return length != 0;
+}
+
+void Wm::collect_titles() {
+	size_t i;
+	for(i = 0; i < title_pending.size(); i++) {
+		Wtitle *t = titles.find(title_pending[i]);
+		if(!t || !(t->seq[0] | t->seq[1])) continue; // already done
+		void *reply;
+		xcb_generic_error_t *err = NULL;
+		if(t->seq[0]) { // _NET_WM_NAME
+			if(!xsrv->poll_for_reply(t->seq[0], &reply, &err)) {
+				break; // later replies have not arrived either
+			}
+			t->seq[0] = 0;
+			free(err);
+			if(take_title(*t, (xcb_get_property_reply_t *)reply)) {
+				xsrv->discard_reply(t->seq[1]);
+				t->seq[1] = 0;
+			}
+		}
+		if(t->seq[1]) { // WM_NAME
+			err = NULL;
+			if(!xsrv->poll_for_reply(t->seq[1], &reply, &err)) {
+				break;
+			}
+			t->seq[1] = 0;
+			free(err);
+			if(!take_title(*t, (xcb_get_property_reply_t *)reply)) {
+				t->name[0] = '\0';
+			}
+		}
+		if(t->window == focuswin) {
+			snprintf(status, 1023, "%s", t->name);
 		}
-		free(reply);
 	}
+	title_pending.erase(title_pending.begin(), title_pending.begin() + i);
 }
 
+void Wm::forget_title(xcb_window_t w) {
+	Wtitle *t = titles.find(w);
+	if(!t) return;
+	for(int i = 0; i < 2; i++) {
+		if(t->seq[i]) xsrv->discard_reply(t->seq[i]);
+	}
+	titles.erase(w);
+}
+
+const char *Wm::get_title(xcb_window_t w) {
+	Wtitle *t = titles.find(w);
+	return t? t->name: "";
+}
+
+#ifndef YWM_NO_MAIN // the fake server benchmark has its own main()
 int main(int argc, char **argv, char **envp) {
 	Wm wm;
 	wm.envp = envp; // pass the environment variables
+	// ywm --replay <trace> [--fast]: handle a recorded trace and exit
+	const char *replay = NULL;
+	bool fast = false;
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "--replay") && i + 1 < argc) {
+			replay = argv[++i];
+		} else if(!strcmp(argv[i], "--fast")) {
+			fast = true;
+		}
+	}
+	if(replay) { // no terminals and no new trace of the replay
+		setenv("YWM_AUTOSTART", "0", 1);
+		unsetenv("YWM_TRACE");
+	}
 	wm.init();
-	wm.event_loop();
+	if(replay) wm.replay(replay, fast);
+	else wm.event_loop();
+	wm.release();
 
 	return 0;
 }
-
+#endif
 